@@ -0,0 +1,49 @@
+#define TOYHASH_COUNT 174
+#define TOYHASH_SIZE 512
+#define TOYHASH_BUCKETS 128
+
+static const unsigned short toy_hash_disp[] = {
+  1,1,1,1,1,1,1,1,1,1,1,1,1,2,1,2,
+  1,1,1,1,1,1,1,1,2,1,1,1,2,1,1,1,
+  1,1,1,2,1,1,2,1,1,5,1,2,1,1,1,2,
+  1,1,1,1,1,1,2,4,1,1,2,1,1,1,1,2,
+  1,1,1,1,1,1,1,2,1,1,1,1,1,1,1,1,
+  5,1,1,1,1,1,2,4,5,1,1,1,1,2,1,1,
+  1,1,1,1,1,2,2,1,1,1,1,2,1,1,1,1,
+  2,2,1,1,1,1,1,1,1,2,1,1,1,1,1,2
+};
+
+static const unsigned short toy_hash_table[] = {
+  0,86,82,95,78,0,0,0,118,0,0,0,0,73,0,84,
+  74,150,144,137,0,123,0,131,0,139,0,0,0,0,101,0,
+  0,0,0,170,0,47,25,80,27,0,0,0,0,0,0,93,
+  94,0,0,0,0,0,0,0,105,0,0,0,0,0,76,0,
+  54,108,130,0,0,0,33,104,0,0,0,0,0,21,0,0,
+  0,0,134,0,0,53,0,0,151,159,0,97,0,0,0,0,
+  138,106,18,59,0,14,32,68,0,0,124,114,0,0,7,0,
+  3,147,0,0,0,0,0,0,0,0,0,0,0,0,45,0,
+  0,57,0,75,0,0,0,0,0,0,157,0,92,0,0,0,
+  0,6,0,0,0,0,0,12,0,0,42,148,119,0,96,0,
+  107,162,0,0,0,72,0,0,2,0,0,0,0,0,4,0,
+  160,0,169,0,0,116,0,0,0,0,0,31,0,0,0,133,
+  0,164,0,1,0,8,9,109,0,0,128,0,43,0,0,16,
+  0,165,0,0,0,0,0,0,0,0,0,0,83,22,0,0,
+  0,0,0,0,46,39,0,0,0,0,0,85,0,0,56,65,
+  11,66,0,0,0,0,0,0,161,0,0,142,0,0,0,0,
+  0,0,0,146,0,0,0,0,0,26,0,0,61,166,0,0,
+  0,29,121,0,173,50,0,0,0,0,0,126,0,13,0,0,
+  35,0,0,0,171,0,71,52,152,0,0,0,135,0,0,0,
+  111,163,0,0,0,125,0,0,0,0,0,19,58,168,0,64,
+  127,0,0,98,0,0,89,115,100,0,0,0,87,0,0,0,
+  90,0,0,136,0,0,172,0,0,0,0,129,0,0,0,0,
+  0,0,0,158,102,0,99,60,0,0,0,17,51,0,0,0,
+  40,0,81,0,0,37,0,0,0,88,49,0,0,0,0,0,
+  0,0,145,0,112,0,0,0,41,48,24,0,0,0,0,0,
+  0,0,0,0,0,15,153,34,0,122,0,141,0,103,0,0,
+  110,63,0,0,28,0,0,0,0,0,67,0,0,0,0,0,
+  0,113,0,0,0,0,0,0,0,0,0,0,154,117,20,44,
+  0,0,0,91,0,0,70,0,132,0,0,0,38,77,0,120,
+  0,0,0,0,0,0,0,149,23,30,0,0,0,0,0,0,
+  0,69,0,167,0,155,62,5,143,0,55,0,10,0,0,0,
+  0,156,0,36,0,0,0,0,0,0,79,0,0,0,140,0
+};
@@ -0,0 +1 @@
+lex.zconf.c_shipped
\ No newline at end of file
@@ -20,43 +20,60 @@ int dirtree_notdotdot(struct dirtree *catch)
   return notdotdot(catch->name) ? DIRTREE_SAVE|DIRTREE_RECURSE : 0;
 }
 
-// Create a dirtree node from a path, with stat and symlink info.
-// (This doesn't open directory filehandles yet so as not to exhaust the
-// filehandle space on large trees, dirtree_handle_callback() does that.)
+// Stat name (relative to dirfd) and allocate a dirtree node for it, with
+// symlink contents appended. Returns NULL with errno set on failure. This
+// doesn't touch the parent node or libbuf, so prefetch threads can call it.
 
-struct dirtree *dirtree_add_node(struct dirtree *parent, char *name, int flags)
+static struct dirtree *stat_node(int fd, char *name, int flags)
 {
-  struct dirtree *dt = NULL;
+  struct dirtree *dt;
   struct stat st;
-  int len = 0, linklen = 0;
-
-  if (name) {
-    // open code this because haven't got node to call dirtree_parentfd() on yet
-    int fd = parent ? parent->data : AT_FDCWD;
-
-    if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW*!(flags&DIRTREE_SYMFOLLOW)))
-      goto error;
-    if (S_ISLNK(st.st_mode)) {
-      if (0>(linklen = readlinkat(fd, name, libbuf, 4095))) goto error;
-      libbuf[linklen++]=0;
-    }
-    len = strlen(name);
+  char buf[4096];
+  int len = strlen(name), linklen = 0;
+
+  if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW*!(flags&DIRTREE_SYMFOLLOW)))
+    return 0;
+  if (S_ISLNK(st.st_mode)) {
+    if (0>(linklen = readlinkat(fd, name, buf, 4095))) return 0;
+    buf[linklen++]=0;
   }
   dt = xzalloc((len = sizeof(struct dirtree)+len+1)+linklen);
-  dt->parent = parent;
-  if (name) {
-    memcpy(&(dt->st), &st, sizeof(struct stat));
-    strcpy(dt->name, name);
-
-    if (linklen) {
-      dt->symlink = memcpy(len+(char *)dt, libbuf, linklen);
-      dt->data = --linklen;
-    }
+  memcpy(&(dt->st), &st, sizeof(struct stat));
+  strcpy(dt->name, name);
+  if (linklen) {
+    dt->symlink = memcpy(len+(char *)dt, buf, linklen);
+    dt->data = --linklen;
   }
 
   return dt;
+}
+
+// Allocate a node for a directory entry. With DIRTREE_LAZY take the type
+// from readdir() when it knows (skipping the stat), else stat it.
+
+static struct dirtree *entry_node(int fd, struct dirent *entry, int flags)
+{
+  struct dirtree *dt;
+
+  // Symlinks still need a stat (to follow) and readlink (to fill out
+  // ->symlink), and some filesystems don't fill out d_type at all.
+  if (!(flags&DIRTREE_LAZY) || entry->d_type == DT_UNKNOWN
+      || entry->d_type == DT_LNK)
+    return stat_node(fd, entry->d_name, flags);
+
+  dt = xzalloc(sizeof(struct dirtree)+strlen(entry->d_name)+1);
+  strcpy(dt->name, entry->d_name);
+  dt->st.st_mode = DTTOIF(entry->d_type);
+  dt->st.st_ino = entry->d_ino;
+  dt->lazy++;
+
+  return dt;
+}
+
+// Complain (unless told to shut up) about failure to stat name under parent.
 
-error:
+static void add_node_error(struct dirtree *parent, char *name, int flags)
+{
   if (!(flags&DIRTREE_SHUTUP) && notdotdot(name)) {
     char *path = parent ? dirtree_path(parent, 0) : "";
 
@@ -64,8 +81,26 @@ error:
     if (parent) free(path);
   }
   if (parent) parent->symlink = (char *)1;
-  free(dt);
-  return 0;
+}
+
+// Create a dirtree node from a path, with stat and symlink info.
+// (This doesn't open directory filehandles yet so as not to exhaust the
+// filehandle space on large trees, dirtree_handle_callback() does that.)
+
+struct dirtree *dirtree_add_node(struct dirtree *parent, char *name, int flags)
+{
+  struct dirtree *dt;
+
+  if (!name) dt = xzalloc(sizeof(struct dirtree)+1);
+  // open code this because haven't got node to call dirtree_parentfd() on yet
+  else if (!(dt = stat_node(parent ? parent->data : AT_FDCWD, name, flags))) {
+    add_node_error(parent, name, flags);
+
+    return 0;
+  }
+  dt->parent = parent;
+
+  return dt;
 }
 
 // Return path to this node, assembled recursively.
@@ -94,11 +129,408 @@ char *dirtree_path(struct dirtree *node, int *plen)
   return path;
 }
 
+// Path of the directory dirtree_recurse() is reading, kept around so
+// dirtree_pathbuf() can append each child's name to it. (len -1 = not yet.)
+static struct {
+  struct dirtree *dir;
+  char *buf;
+  int len, size;
+} pathbuf;
+
+// Append name to the first len bytes of pathbuf.buf, returning new length.
+static int pathbuf_name(int len, char *name)
+{
+  int nlen = strlen(name);
+
+  if (len+nlen+2 > pathbuf.size)
+    pathbuf.buf = xrealloc(pathbuf.buf, pathbuf.size = len+nlen+256);
+  if (len && pathbuf.buf[len-1] != '/') pathbuf.buf[len++] = '/';
+  memcpy(pathbuf.buf+len, name, nlen+1);
+
+  return len+nlen;
+}
+
+// Write node's path into pathbuf.buf, returning length.
+static int pathbuf_add(struct dirtree *node)
+{
+  return pathbuf_name(node->parent ? pathbuf_add(node->parent) : 0,
+                      node->name);
+}
+
+// Like dirtree_path(), but returns a buffer that's only good until the next
+// call (don't free it). For children of the directory being read this just
+// appends the name instead of walking up the tree and allocating.
+
+char *dirtree_pathbuf(struct dirtree *node)
+{
+  struct dirtree *dir = node->parent;
+
+  if (dir && dir == pathbuf.dir) {
+    if (pathbuf.len < 0) pathbuf.len = pathbuf_add(dir);
+    pathbuf_name(pathbuf.len, node->name);
+  } else {
+    pathbuf.len = -1;
+    pathbuf_add(node);
+  }
+
+  return pathbuf.buf;
+}
+
 int dirtree_parentfd(struct dirtree *node)
 {
   return node->parent ? node->parent->data : AT_FDCWD;
 }
 
+// Fill out the rest of st for a node DIRTREE_LAZY didn't stat. Complains and
+// returns nonzero on failure.
+
+int dirtree_stat(struct dirtree *node)
+{
+  struct stat st;
+
+  if (!node->lazy) return 0;
+  node->lazy = 0;
+  if (fstatat(dirtree_parentfd(node), node->name, &st, AT_SYMLINK_NOFOLLOW)) {
+    char *path = dirtree_path(node, 0);
+
+    perror_msg("%s", path);
+    free(path);
+
+    return 1;
+  }
+  memcpy(&(node->st), &st, sizeof(struct stat));
+
+  return 0;
+}
+
+// With DIRTREE_PARALLEL a pool of threads reads directories (and stats their
+// contents) ahead of the traversal, so readdir()/fstatat() latency on NFS or
+// cold caches overlaps. Callbacks still happen one at a time, in the same
+// order, in the calling thread.
+//
+// Each directory found gets a job (with its own filehandle) queued on a
+// worker's deque, and node->prefetch points to the job. Workers queue
+// subdirectories at the front of their own deque in directory order and
+// take work from the front too (depth first, the order the traversal wants
+// it), idle workers steal from the back of other deques (big subtrees near
+// the top). When the traversal reaches a directory it waits for its job, or
+// runs it itself if nobody has started it yet.
+
+#define PREFETCH_LATER ((void *)1)
+
+struct prefetch {
+  struct prefetch *next, *prev;
+  struct dirtree *child;
+  int fd, flags, state, deque, err;
+};
+
+enum {PREFETCH_QUEUED, PREFETCH_RUNNING, PREFETCH_DONE, PREFETCH_CANCEL};
+
+static struct prefetch_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t work, done;
+  struct prefetch **deque;
+  int threads, jobs, maxjobs, rr, running;
+} *pool;
+
+static void prefetch_cancel(struct dirtree *node);
+
+// Free a list of nodes read by a prefetch job, cancelling their own jobs.
+static void free_prefetched(struct dirtree *dt)
+{
+  while (dt) {
+    struct dirtree *next = dt->next;
+
+    prefetch_cancel(dt);
+    free(dt);
+    dt = next;
+  }
+}
+
+// Remove job from its deque. Call with pool->lock held.
+static void prefetch_unlink(struct prefetch *job)
+{
+  struct prefetch **list = pool->deque+job->deque;
+
+  if (job->next == job) *list = 0;
+  else {
+    job->prev->next = job->next;
+    job->next->prev = job->prev;
+    if (*list == job) *list = job->next;
+  }
+}
+
+// Discard node's prefetch job (if any), freeing whatever it read.
+static void prefetch_cancel(struct dirtree *node)
+{
+  struct prefetch *job = node->prefetch;
+
+  node->prefetch = 0;
+  if (!job || job == PREFETCH_LATER) return;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->jobs--;
+  if (job->state == PREFETCH_QUEUED) {
+    prefetch_unlink(job);
+    close(job->fd);
+  } else if (job->state == PREFETCH_RUNNING) {
+    // The worker frees it when done
+    job->state = PREFETCH_CANCEL;
+    job = 0;
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  if (job) {
+    free_prefetched(job->child);
+    free(job);
+  }
+}
+
+// Create a job to read directory name (under dirfd), if we have room for
+// another one. Returns the job or PREFETCH_LATER.
+static void *prefetch_new(int dirfd, char *name, int flags)
+{
+  struct prefetch *job;
+  int fd;
+
+  pthread_mutex_lock(&pool->lock);
+  if ((fd = pool->jobs < pool->maxjobs)) pool->jobs++;
+  pthread_mutex_unlock(&pool->lock);
+  if (!fd) return PREFETCH_LATER;
+
+  if (-1 == (fd = openat(dirfd, name, O_RDONLY|O_DIRECTORY|O_CLOEXEC))) {
+    pthread_mutex_lock(&pool->lock);
+    pool->jobs--;
+    pthread_mutex_unlock(&pool->lock);
+
+    return PREFETCH_LATER;
+  }
+  job = xzalloc(sizeof(struct prefetch));
+  job->fd = fd;
+  job->flags = flags;
+
+  return job;
+}
+
+// Read all entries of dir into job->child, queueing jobs for subdirectories.
+// Worker "me" queues to its own deque, -1 means round robin.
+static void prefetch_scan(struct prefetch *job, DIR *dir, int me)
+{
+  struct dirtree *dt, **ddt = &job->child;
+  struct prefetch *last = 0, *new;
+  struct dirent *entry;
+
+  while ((entry = readdir(dir))) {
+    // Remember failure to stat, so traversal can complain in order later.
+    if (!(dt = entry_node(dirfd(dir), entry, job->flags))) {
+      dt = xzalloc(sizeof(struct dirtree)+strlen(entry->d_name)+1);
+      strcpy(dt->name, entry->d_name);
+      dt->data = errno;
+    } else if (S_ISDIR(dt->st.st_mode)) {
+      dt->prefetch = PREFETCH_LATER;
+      if (notdotdot(dt->name)
+        && PREFETCH_LATER != (new = prefetch_new(dirfd(dir), dt->name,
+                                                 job->flags)))
+      {
+        struct prefetch **list;
+
+        pthread_mutex_lock(&pool->lock);
+        // Siblings stay in directory order, after the first one we queued
+        if (last && last->state == PREFETCH_QUEUED && last->deque == me) {
+          new->next = last->next;
+          new->prev = last;
+          last->next->prev = new;
+          last->next = new;
+          new->deque = me;
+        } else {
+          new->deque = (me == -1) ? pool->rr++%pool->threads : me;
+          list = pool->deque+new->deque;
+          dlist_add_nomalloc((void *)list, (void *)new);
+          *list = new;
+        }
+        pthread_cond_signal(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+        dt->prefetch = last = new;
+      }
+    }
+    *ddt = dt;
+    ddt = &dt->next;
+  }
+}
+
+// Read job's directory, consuming its filehandle.
+static void prefetch_run(struct prefetch *job, int me)
+{
+  DIR *dir = fdopendir(job->fd);
+
+  if (!dir) {
+    job->err = errno;
+    close(job->fd);
+  } else {
+    prefetch_scan(job, dir, me);
+    closedir(dir);
+  }
+}
+
+static void *prefetch_worker(void *arg)
+{
+  struct prefetch *job;
+  int me = (long)arg, i;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    // Take newest job from our own deque, else steal oldest from another.
+    if (!(job = pool->deque[me])) {
+      for (i = 1; i<pool->threads; i++)
+        if ((job = pool->deque[(me+i)%pool->threads])) break;
+      if (job) job = job->prev;
+    }
+    if (!job) {
+      pthread_cond_wait(&pool->work, &pool->lock);
+      continue;
+    }
+    prefetch_unlink(job);
+    job->state = PREFETCH_RUNNING;
+    pool->running++;
+    pthread_mutex_unlock(&pool->lock);
+
+    prefetch_run(job, me);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->running--;
+    if (job->state == PREFETCH_CANCEL) {
+      pthread_mutex_unlock(&pool->lock);
+      free_prefetched(job->child);
+      free(job);
+      pthread_mutex_lock(&pool->lock);
+    } else job->state = PREFETCH_DONE;
+    pthread_cond_broadcast(&pool->done);
+  }
+
+  return 0;
+}
+
+// Out of filehandles: close the ones queued jobs are holding (the traversal
+// reads those directories itself later) and queue fewer from now on. If
+// nothing was queued, wait for a running job to finish with its filehandle.
+// Returns 1 if it's worth retrying.
+static int prefetch_shed(void)
+{
+  struct prefetch *job;
+  int i, shed = 0, err = errno;
+
+  if (!pool || (err != EMFILE && err != ENFILE)) return 0;
+
+  pthread_mutex_lock(&pool->lock);
+  for (i = 0; i<pool->threads; i++) while ((job = pool->deque[i])) {
+    prefetch_unlink(job);
+    close(job->fd);
+    job->err = err;
+    job->state = PREFETCH_DONE;
+    shed++;
+  }
+  if (pool->maxjobs>1) pool->maxjobs /= 2;
+  if (!shed && pool->running) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+    shed++;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  errno = err;
+
+  return !!shed;
+}
+
+// Start worker threads the first time we need them. (They're never stopped,
+// exit() takes care of that.)
+static void prefetch_start(void)
+{
+  struct rlimit rl;
+  sigset_t all, old;
+  pthread_t tid;
+  long i = sysconf(_SC_NPROCESSORS_ONLN);
+
+  pool = xzalloc(sizeof(struct prefetch_pool));
+  pthread_mutex_init(&pool->lock, 0);
+  pthread_cond_init(&pool->work, 0);
+  pthread_cond_init(&pool->done, 0);
+
+  // Directory reads are mostly waiting on I/O, so use more threads than CPUs
+  pool->threads = (i<1) ? 2 : (i>8) ? 16 : 2*i;
+  pool->deque = xzalloc(pool->threads*sizeof(struct prefetch *));
+
+  // Queued jobs hold a filehandle open, so leave plenty for everyone else.
+  pool->maxjobs = 1024;
+  if (!getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur/4 < pool->maxjobs)
+    pool->maxjobs = rl.rlim_cur/4;
+
+  // Signals go to the main thread. If threads fail to start, the traversal
+  // runs every job itself.
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  for (i = 0; i<pool->threads; i++)
+    if (pthread_create(&tid, 0, prefetch_worker, (void *)i)) break;
+  pthread_sigmask(SIG_SETMASK, &old, 0);
+}
+
+// Fetch the list of entries in directory node (with dirfd in data), from its
+// prefetch job if it has one, else reading it now (through *dir, which the
+// caller closes). Returns 0 for success.
+static int prefetch_take(struct dirtree *node, int flags, struct dirtree **list,
+  DIR **dir)
+{
+  struct prefetch *job = node->prefetch;
+
+  node->prefetch = 0;
+  if (!pool) prefetch_start();
+
+  if (job && job != PREFETCH_LATER) {
+    pthread_mutex_lock(&pool->lock);
+    pool->jobs--;
+    // Nobody's started it yet, so do it ourselves.
+    if (job->state == PREFETCH_QUEUED) {
+      prefetch_unlink(job);
+      job->state = PREFETCH_RUNNING;
+      pthread_mutex_unlock(&pool->lock);
+      prefetch_run(job, -1);
+      pthread_mutex_lock(&pool->lock);
+      job->state = PREFETCH_DONE;
+    }
+    while (job->state != PREFETCH_DONE)
+      pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    // Read ahead assumed the same flags as our parent, was that right?
+    if (!job->err
+      && !((job->flags^flags)&(DIRTREE_SYMFOLLOW|DIRTREE_LAZY)))
+    {
+      *list = job->child;
+      free(job);
+
+      return 0;
+    }
+    free_prefetched(job->child);
+    free(job);
+  }
+
+  // Read it now (queueing subdirectories for the workers).
+  if (!(*dir = fdopendir(node->data))) return 1;
+  job = xzalloc(sizeof(struct prefetch));
+  job->flags = flags;
+  prefetch_scan(job, *dir, -1);
+  *list = job->child;
+  free(job);
+
+  return 0;
+}
+
+// Free a node the caller got from the traversal (not its children),
+// cancelling any directory read-ahead still queued for it.
+void dirtree_free(struct dirtree *node)
+{
+  if (CFG_TOYBOX_THREADS) prefetch_cancel(node);
+  free(node);
+}
+
 // Handle callback for a node in the tree. Returns saved node(s) or NULL.
 //
 // By default, allocates a tree of struct dirtree, not following symlinks
@@ -118,14 +550,15 @@ struct dirtree *dirtree_handle_callback(struct dirtree *new,
 
   if (S_ISDIR(new->st.st_mode)) {
     if (flags & (DIRTREE_RECURSE|DIRTREE_COMEAGAIN)) {
-      new->data = openat(dirtree_parentfd(new), new->name, O_CLOEXEC);
+      do new->data = openat(dirtree_parentfd(new), new->name, O_CLOEXEC);
+      while (CFG_TOYBOX_THREADS && new->data == -1 && prefetch_shed());
       flags = dirtree_recurse(new, callback, flags);
     }
   }
 
   // If this had children, it was callback's job to free them already.
   if (!(flags & DIRTREE_SAVE)) {
-    free(new);
+    dirtree_free(new);
     new = NULL;
   }
 
@@ -138,11 +571,15 @@ struct dirtree *dirtree_handle_callback(struct dirtree *new,
 int dirtree_recurse(struct dirtree *node,
           int (*callback)(struct dirtree *node), int flags)
 {
-  struct dirtree *new, **ddt = &(node->child);
+  struct dirtree *new, *list = 0, **ddt = &(node->child), *pbdir;
   struct dirent *entry;
-  DIR *dir;
+  DIR *dir = 0;
+  int parallel = CFG_TOYBOX_THREADS
+    && (node->prefetch || (flags & DIRTREE_PARALLEL));
 
-  if (node->data == -1 || !(dir = fdopendir(node->data))) {
+  if (node->data == -1 || (parallel ? prefetch_take(node, flags, &list, &dir)
+                                    : !(dir = fdopendir(node->data))))
+  {
     if (!(flags & DIRTREE_SHUTUP)) {
       char *path = dirtree_path(node, 0);
       perror_msg("No %s", path);
@@ -156,9 +593,33 @@ int dirtree_recurse(struct dirtree *node,
   // according to the fddir() man page, the filehandle in the DIR * can still
   // be externally used by things that don't lseek() it.
 
-  // The extra parentheses are to shut the stupid compiler up.
-  while ((entry = readdir(dir))) {
-    if (!(new = dirtree_add_node(node, entry->d_name, flags))) continue;
+  // Children's paths start with ours (saving enclosing directory's state).
+  pbdir = pathbuf.dir;
+  pathbuf.dir = node;
+  pathbuf.len = -1;
+
+  for (;;) {
+    if (parallel) {
+      if (!(new = list)) break;
+      list = new->next;
+      new->next = 0;
+      new->parent = node;
+
+      // Prefetch couldn't stat this one, so complain now.
+      if (!new->st.st_mode) {
+        errno = new->data;
+        add_node_error(node, new->name, flags);
+        free(new);
+        continue;
+      }
+    } else {
+      if (!(entry = readdir(dir))) break;
+      if (!(new = entry_node(node->data, entry, flags))) {
+        add_node_error(node, entry->d_name, flags);
+        continue;
+      }
+      new->parent = node;
+    }
     new = dirtree_handle_callback(new, callback);
     if (new == DIRTREE_ABORTVAL) break;
     if (new) {
@@ -166,6 +627,9 @@ int dirtree_recurse(struct dirtree *node,
       ddt = &((*ddt)->next);
     }
   }
+  if (parallel) free_prefetched(list);
+  pathbuf.dir = pbdir;
+  pathbuf.len = -1;
 
   if (flags & DIRTREE_COMEAGAIN) {
     node->again++;
@@ -173,7 +637,8 @@ int dirtree_recurse(struct dirtree *node,
   }
 
   // This closes filehandle as well, so note it
-  closedir(dir);
+  if (dir) closedir(dir);
+  else close(node->data);
   node->data = -1;
 
   return flags;
@@ -191,7 +656,19 @@ struct dirtree *dirtree_start(char *name, int symfollow)
 
 struct dirtree *dirtree_read(char *path, int (*callback)(struct dirtree *node))
 {
-  struct dirtree *root = dirtree_start(path, 0);
+  return dirtree_flagread(path, 0, callback);
+}
+
+// Same, but with DIRTREE_SYMFOLLOW or DIRTREE_PARALLEL applying to path too.
+
+struct dirtree *dirtree_flagread(char *path, int flags,
+  int (*callback)(struct dirtree *node))
+{
+  struct dirtree *root = dirtree_add_node(0, path, flags);
+
+  if (!root) return DIRTREE_ABORTVAL;
+  if (CFG_TOYBOX_THREADS && (flags & DIRTREE_PARALLEL))
+    root->prefetch = PREFETCH_LATER;
 
-  return root ? dirtree_handle_callback(root, callback) : DIRTREE_ABORTVAL;
+  return dirtree_handle_callback(root, callback);
 }
@@ -71,6 +71,10 @@ ssize_t readall(int fd, void *buf, size_t len)
     if (!i) break;
     if (i<0) return i;
     count += i;
+    if (CFG_TOYBOX_STATS) {
+      TOYSTAT(reads, 1);
+      TOYSTAT(rbytes, i);
+    }
   }
 
   return count;
@@ -84,6 +88,10 @@ ssize_t writeall(int fd, void *buf, size_t len)
     int i = write(fd, count+(char *)buf, len-count);
     if (i<1) return i;
     count += i;
+    if (CFG_TOYBOX_STATS) {
+      TOYSTAT(writes, 1);
+      TOYSTAT(wbytes, i);
+    }
   }
 
   return count;
@@ -505,32 +513,101 @@ void loopfiles(char **argv, void (*function)(int fd, char *name))
   loopfiles_rw(argv, O_RDONLY|O_CLOEXEC, 0, 0, function);
 }
 
-// Slow, but small.
+// Buffered line reader: read input in large blocks and hand out each line
+// in place, nul terminated, without copying it. The returned line is only
+// valid until the next call on the same linebuf.
 
-char *get_rawline(int fd, long *plen, char end)
+struct linebuf *linebuf_new(int fd)
 {
-  char c, *buf = NULL;
-  long len = 0;
+  struct linebuf *lb = xzalloc(sizeof(struct linebuf));
+
+  lb->fd = fd;
+  if (lseek(fd, 0, SEEK_CUR) != -1) lb->flags = LINEBUF_SEEKABLE;
+  lb->buf = xmalloc(lb->size = 4096);
+
+  return lb;
+}
+
+// Return next line (including end character) and its length, or NULL at EOF.
+char *linebuf_raw(struct linebuf *lb, long *plen, char end)
+{
+  char *s, *line;
+  long len, scan = 0;
+
+  // Put back the byte we overwrote with a null terminator last time.
+  lb->buf[lb->start] = lb->save;
 
   for (;;) {
-    if (1>read(fd, &c, 1)) break;
-    if (!(len & 63)) buf=xrealloc(buf, len+65);
-    if ((buf[len++]=c) == end) break;
+    len = lb->end-lb->start;
+    if (len>scan && (s = memchr(lb->buf+lb->start+scan, end, len-scan))) {
+      len = s+1-(lb->buf+lb->start);
+      break;
+    }
+    scan = len;
+
+    // Need more data: slide partial line to start of buffer, grow if full.
+    if (lb->start) {
+      memmove(lb->buf, lb->buf+lb->start, len);
+      lb->end = len;
+      lb->start = 0;
+    }
+    if (lb->end+1 == lb->size) lb->buf = xrealloc(lb->buf, lb->size *= 2);
+    len = read(lb->fd, lb->buf+lb->end, lb->size-lb->end-1);
+    if (CFG_TOYBOX_STATS && len>0) {
+      TOYSTAT(reads, 1);
+      TOYSTAT(rbytes, len);
+    }
+    if (len<1) {
+      if (!(len = lb->end-lb->start)) {
+        lb->save = 0;
+
+        return 0;
+      }
+      break;
+    }
+    lb->end += len;
   }
-  if (buf) buf[len]=0;
+
+  line = lb->buf+lb->start;
+  lb->start += len;
+
+  lb->save = lb->buf[lb->start];
+  lb->buf[lb->start] = 0;
   if (plen) *plen = len;
 
-  return buf;
+  return line;
 }
 
-char *get_line(int fd)
+// Return next line with trailing newline stripped, or NULL at EOF.
+char *linebuf_line(struct linebuf *lb)
 {
   long len;
-  char *buf = get_rawline(fd, &len, '\n');
+  char *line = linebuf_raw(lb, &len, '\n');
 
-  if (buf && buf[--len]=='\n') buf[len]=0;
+  if (line && line[--len]=='\n') line[len] = 0;
 
-  return buf;
+  return line;
+}
+
+// Is a whole line (through end character) already buffered, so the next
+// linebuf_raw() won't block?
+int linebuf_pending(struct linebuf *lb, char end)
+{
+  // The first byte was swapped out for the null terminator, it's in save.
+  if (lb->end == lb->start) return 0;
+
+  return lb->save == end
+    || memchr(lb->buf+lb->start+1, end, lb->end-lb->start-1);
+}
+
+// Free linebuf, returning unused readahead to a seekable fd.
+void linebuf_free(struct linebuf *lb)
+{
+  if (!lb) return;
+  if ((lb->flags&LINEBUF_SEEKABLE) && lb->end != lb->start)
+    lseek(lb->fd, lb->start-lb->end, SEEK_CUR);
+  free(lb->buf);
+  free(lb);
 }
 
 int wfchmodat(int fd, char *name, mode_t mode)
@@ -615,6 +692,67 @@ void crc_init(unsigned int *crc_table, int little_endian)
   }
 }
 
+// Slice-by-8 tables: table k advances a crc through a byte followed by k zero
+// bytes, so 8 lookups (which don't depend on each other) do 8 bytes at once.
+// Filled in on first use, threaded callers should make one call up front.
+static unsigned crc_slice[2][8][256];
+static char crc_ready[2];
+
+static unsigned (*crc_tables(int little_endian))[256]
+{
+  unsigned (*t)[256] = crc_slice[little_endian], i, k, c;
+
+  if (!crc_ready[little_endian]) {
+    crc_init(*t, little_endian);
+    for (k = 1; k<8; k++) for (i = 0; i<256; i++) {
+      c = t[k-1][i];
+      t[k][i] = little_endian ? (c>>8)^t[0][c&255] : (c<<8)^t[0][c>>24];
+    }
+    crc_ready[little_endian]++;
+  }
+
+  return t;
+}
+
+// Update crc32 with len bytes of data, little endian (gzip, xz) version.
+// No pre or post inversion, caller does that.
+unsigned crc32_le(unsigned crc, void *data, unsigned long len)
+{
+  unsigned (*t)[256] = crc_tables(1), a, b;
+  unsigned char *s = data;
+
+  for (; len>=8; len -= 8, s += 8) {
+    memcpy(&a, s, 4);
+    memcpy(&b, s+4, 4);
+    a = SWAP_LE32(a)^crc;
+    b = SWAP_LE32(b);
+    crc = t[7][a&255]^t[6][(a>>8)&255]^t[5][(a>>16)&255]^t[4][a>>24]
+      ^t[3][b&255]^t[2][(b>>8)&255]^t[1][(b>>16)&255]^t[0][b>>24];
+  }
+  while (len--) crc = t[0][(crc^*s++)&255]^(crc>>8);
+
+  return crc;
+}
+
+// Big endian (cksum, bzip2) version of crc32_le()
+unsigned crc32_be(unsigned crc, void *data, unsigned long len)
+{
+  unsigned (*t)[256] = crc_tables(0), a, b;
+  unsigned char *s = data;
+
+  for (; len>=8; len -= 8, s += 8) {
+    memcpy(&a, s, 4);
+    memcpy(&b, s+4, 4);
+    a = SWAP_BE32(a)^crc;
+    b = SWAP_BE32(b);
+    crc = t[7][a>>24]^t[6][(a>>16)&255]^t[5][(a>>8)&255]^t[4][a&255]
+      ^t[3][b>>24]^t[2][(b>>16)&255]^t[1][(b>>8)&255]^t[0][b&255];
+  }
+  while (len--) crc = (crc<<8)^t[0][(crc>>24)^*s++];
+
+  return crc;
+}
+
 // Init base64 table
 
 void base64_init(char *p)
@@ -908,3 +1046,65 @@ int xpoll(struct pollfd *fds, int nfds, int timeout)
     } else return i;
   }
 }
+
+// Find the slot for (dev, ino) in a table of size entries (a power of 2).
+static struct ino_entry *ino_slot(struct ino_entry *table, unsigned long size,
+  dev_t dev, ino_t ino)
+{
+  unsigned long i = (ino^((unsigned long long)dev<<17)^(dev>>15))
+                    *0x9E3779B97F4A7C15ULL;
+
+  // Open addressing with linear probing. (dev, ino) of 0,0 is an empty slot.
+  for (i >>= 16;; i++) {
+    struct ino_entry *ie = table+(i&(size-1));
+
+    if ((ie->dev == dev && ie->ino == ino) || !(ie->dev || ie->ino)) return ie;
+  }
+}
+
+// If st could be a hardlink (a non-directory with link count > 1), return
+// a pointer to the data slot for its (dev, ino), adding a new entry with
+// data NULL the first time we see it. Else return NULL.
+//
+// (Skipping dir nodes isn't _quite_ right. They're not hardlinked, but could
+// be bind mounted. Still, it's more efficient and the archivers can't use
+// hardlinked directory info anyway. Note that we don't catch bind mounted
+// _files_ because it doesn't change st_nlink.)
+void **ino_hash(struct ino_hash *ih, struct stat *st)
+{
+  struct ino_entry *ie;
+
+  if (S_ISDIR(st->st_mode) || st->st_nlink < 2) return 0;
+
+  // Keep the table at most half full, so probes stay short.
+  if (2*(ih->used+1) > ih->size) {
+    struct ino_entry *old = ih->table;
+    unsigned long i, size = ih->size;
+
+    ih->size = size ? 2*size : 256;
+    ih->table = xzalloc(ih->size*sizeof(struct ino_entry));
+    for (i = 0; i<size; i++) if (old[i].dev || old[i].ino)
+      *ino_slot(ih->table, ih->size, old[i].dev, old[i].ino) = old[i];
+    free(old);
+  }
+
+  ie = ino_slot(ih->table, ih->size, st->st_dev, st->st_ino);
+  if (!(ie->dev || ie->ino)) {
+    ie->dev = st->st_dev;
+    ie->ino = st->st_ino;
+    ih->used++;
+  }
+
+  return &ie->data;
+}
+
+// Free ino_hash table, calling freeit() on non-NULL data if provided.
+void ino_hash_free(struct ino_hash *ih, void (*freeit)(void *))
+{
+  unsigned long i;
+
+  if (freeit) for (i = 0; i<ih->size; i++)
+    if (ih->table[i].data) freeit(ih->table[i].data);
+  free(ih->table);
+  memset(ih, 0, sizeof(struct ino_hash));
+}
@@ -52,6 +52,11 @@ void get_optflags(void);
 #define DIRTREE_SYMFOLLOW    8
 // Don't warn about failure to stat
 #define DIRTREE_SHUTUP      16
+// Read directories ahead in other threads (callbacks stay serialized)
+#define DIRTREE_PARALLEL    32
+// Only stat children when readdir() can't say what type they are, the rest
+// of st gets filled out by dirtree_stat()
+#define DIRTREE_LAZY        64
 // Don't look at any more files in this directory.
 #define DIRTREE_ABORT      256
 
@@ -62,21 +67,28 @@ struct dirtree {
   long extra; // place for user to store their stuff (can be pointer)
   struct stat st;
   char *symlink;
+  void *prefetch; // directory contents being read ahead by DIRTREE_PARALLEL
   int data;  // dirfd for directory, linklen for symlink
   char again;
+  char lazy; // st only has type and inode so far, see dirtree_stat()
   char name[];
 };
 
 struct dirtree *dirtree_start(char *name, int symfollow);
 struct dirtree *dirtree_add_node(struct dirtree *p, char *name, int flags);
 char *dirtree_path(struct dirtree *node, int *plen);
+char *dirtree_pathbuf(struct dirtree *node);
 int dirtree_notdotdot(struct dirtree *catch);
 int dirtree_parentfd(struct dirtree *node);
+int dirtree_stat(struct dirtree *node);
+void dirtree_free(struct dirtree *node);
 struct dirtree *dirtree_handle_callback(struct dirtree *new,
   int (*callback)(struct dirtree *node));
 int dirtree_recurse(struct dirtree *node, int (*callback)(struct dirtree *node),
   int symfollow);
 struct dirtree *dirtree_read(char *path, int (*callback)(struct dirtree *node));
+struct dirtree *dirtree_flagread(char *path, int flags,
+  int (*callback)(struct dirtree *node));
 
 // help.c
 
@@ -136,6 +148,17 @@ void xregcomp(regex_t *preg, char *rexec, int cflags);
 char *xtzset(char *new);
 void xsignal(int signal, void *handler);
 
+// regex.c
+struct regdfa {
+  regex_t re;           // libc's version, for what the DFA can't do
+  struct rxprog *prog;  // DFA matcher, or NULL if the regex needs libc
+};
+int regdfa_comp(struct regdfa *rd, char *regex, int cflags);
+int regdfa_exec(struct regdfa *rd, char *s, size_t nmatch, regmatch_t *pm,
+  int eflags);
+void xregdfa(struct regdfa *rd, char *regex, int cflags);
+void regdfa_free(struct regdfa *rd);
+
 // lib.c
 void verror_msg(char *msg, int err, va_list va);
 void error_msg(char *msg, ...) printf_format;
@@ -167,20 +190,50 @@ off_t fdlength(int fd);
 void loopfiles_rw(char **argv, int flags, int permissions, int failok,
   void (*function)(int fd, char *name));
 void loopfiles(char **argv, void (*function)(int fd, char *name));
-char *get_rawline(int fd, long *plen, char end);
-char *get_line(int fd);
+
+// Buffered line reader
+struct linebuf {
+  int fd, flags;
+  char *buf, save;
+  long size, start, end;
+};
+
+// Set by linebuf_new() when we can lseek() back unused input.
+#define LINEBUF_SEEKABLE 1
+
+struct linebuf *linebuf_new(int fd);
+char *linebuf_raw(struct linebuf *lb, long *plen, char end);
+char *linebuf_line(struct linebuf *lb);
+int linebuf_pending(struct linebuf *lb, char end);
+void linebuf_free(struct linebuf *lb);
+
 void xsendfile(int in, int out);
 int wfchmodat(int rc, char *name, mode_t mode);
 int copy_tempfile(int fdin, char *name, char **tempname);
 void delete_tempfile(int fdin, int fdout, char **tempname);
 void replace_tempfile(int fdin, int fdout, char **tempname);
 void crc_init(unsigned int *crc_table, int little_endian);
+unsigned crc32_le(unsigned crc, void *data, unsigned long len);
+unsigned crc32_be(unsigned crc, void *data, unsigned long len);
 void base64_init(char *p);
 int yesno(char *prompt, int def);
 int human_readable(char *buf, unsigned long long num);
 int qstrcmp(const void *a, const void *b);
 int xpoll(struct pollfd *fds, int nfds, int timeout);
 
+// Hash of (dev, ino) pairs seen, for spotting hardlinks. Zero it to init.
+struct ino_hash {
+  struct ino_entry {
+    dev_t dev;
+    ino_t ino;
+    void *data;
+  } *table;
+  unsigned long used, size;
+};
+
+void **ino_hash(struct ino_hash *ih, struct stat *st);
+void ino_hash_free(struct ino_hash *ih, void (*freeit)(void *));
+
 // interestingtimes.c
 int xgettty(void);
 int terminal_size(unsigned *xx, unsigned *yy);
@@ -111,6 +111,7 @@ int update_password(char *filename, char* username, char* entry)
   char *filenamesfx = NULL, *namesfx = NULL, *shadow = NULL,
        *sfx = NULL, *line = NULL;
   FILE *exfp, *newfp;
+  struct linebuf *lb;
   int ret = -1, found = 0;
   struct flock lock;
 
@@ -150,7 +151,8 @@ int update_password(char *filename, char* username, char* entry)
 
   ret = 0;
   namesfx = xmprintf("%s:",username);
-  while ((line = get_line(fileno(exfp))) != NULL)
+  lb = linebuf_new(fileno(exfp));
+  while ((line = linebuf_line(lb)) != NULL)
   {
     if (strncmp(line, namesfx, strlen(namesfx)))
       fprintf(newfp, "%s\n", line);
@@ -176,8 +178,8 @@ int update_password(char *filename, char* username, char* entry)
         fprintf(newfp, "%s\n", entry);
       }
     }
-    free(line);
   }
+  linebuf_free(lb);
   free(namesfx);
   if (!found && entry) fprintf(newfp, "%s\n", entry);
   fcntl(fileno(exfp), F_SETLK, &lock);
@@ -69,6 +69,10 @@ int wcwidth(wchar_t wc);
 #include <time.h>
 char *strptime(const char *buf, const char *format, struct tm *tm);
 
+// Not posix, but in every libc we care about. Glibc hides it behind GNU.
+void *memmem(const void *haystack, size_t haystacklen, const void *needle,
+  size_t needlelen);
+
 // They didn't like posix basename so they defined another function with the
 // same name and if you include libgen.h it #defines basename to something
 // else (where they implemented the real basename), and that define breaks
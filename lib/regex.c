@@ -0,0 +1,666 @@
+/* regex.c - POSIX regular expressions matched by a lazily built DFA
+ *
+ * regdfa_comp() calls regcomp() and also parses the regex into a Thompson
+ * NFA, whose DFA states get built (and cached) as regdfa_exec() needs them.
+ * Anything the DFA can't do (backreferences, subexpression offsets,
+ * REG_NEWLINE, locale dependent bracket expressions) falls back to libc.
+ *
+ * A match runs the DFA forward to see if anything matches at all, then the
+ * reversed regex backward to find the leftmost start, then forward anchored
+ * there for the longest end. Each pass is linear in the string length.
+ */
+
+#include "toys.h"
+
+// NFA nodes: match one byte from set, fork, assertions, done.
+#define RX_SET   0
+#define RX_SPLIT 1
+#define RX_BOL   2
+#define RX_EOL   3
+#define RX_MATCH 4
+
+// Parse tree adds these (RX_REP repeats a from min to max times, -1 = any)
+#define RX_CAT   5
+#define RX_ALT   6
+#define RX_REP   7
+#define RX_EMPTY 8
+
+// DFA state flags. The first two are part of the state's identity.
+#define RXS_FLOAT    1  // not anchored: a match can start at any position
+#define RXS_BOL      2  // start of string, so ^ is satisfied
+#define RXS_MATCH    4  // a match ends here
+#define RXS_EOLMATCH 8  // a match ends here if it's the end of the string
+#define RXS_DEAD    16  // nothing can match from here
+
+// Limits before falling back to libc (nodes) or starting over (states)
+#define RX_MAXNODE   16384
+#define RX_MAXSTATE  1024
+#define RX_MAXPOOL   (1<<20)
+
+struct rxtree {
+  int type, a, b, set, min, max;
+};
+
+struct rxnode {
+  int type, out, out1, set;
+};
+
+// One direction of the regex: NFA plus the DFA states built from it so far.
+struct rxdfa {
+  struct rxnode *node;
+  int nnode, start, *mark, gen, *stack, *tmp, ntmp;
+
+  // state i is pool[stset[i]] for stlen[i] nodes, next[i*ncls+class]
+  int nstate, flushes, *pool, npool, maxpool, *stset, *stlen, *next, *hash,
+      begin[4];
+  unsigned char *stflags;
+};
+
+struct rxprog {
+  char *sets;
+  int ncls, cflags, fail;
+  unsigned char cls[256];
+  struct rxdfa fwd, rev;
+};
+
+struct rxparse {
+  char *s, *sets;
+  int ere, icase, utf8, depth, fail, ntree, nsets;
+  struct rxtree *tree;
+};
+
+// Give up on parsing (libc gets it), and stop the parser where it is.
+static int rx_fail(struct rxparse *p)
+{
+  p->fail++;
+  p->s = "";
+
+  return 0;
+}
+
+static int rx_tree(struct rxparse *p, int type, int a, int b)
+{
+  struct rxtree *t;
+
+  if (!(p->ntree&255))
+    p->tree = xrealloc(p->tree, (p->ntree+256)*sizeof(struct rxtree));
+  t = memset(p->tree+p->ntree, 0, sizeof(struct rxtree));
+  t->type = type;
+  t->a = a;
+  t->b = b;
+
+  return p->ntree++;
+}
+
+// New leaf matching an (initially empty) set of bytes
+static int rx_set(struct rxparse *p)
+{
+  int t = rx_tree(p, RX_SET, 0, 0);
+
+  if (!(p->nsets&63)) p->sets = xrealloc(p->sets, (p->nsets+64)*32);
+  memset(p->sets+32*p->nsets, 0, 32);
+  p->tree[t].set = p->nsets++;
+
+  return t;
+}
+
+static void rx_range(struct rxparse *p, int t, int lo, int hi)
+{
+  char *set = p->sets+32*p->tree[t].set;
+
+  for (; lo<=hi; lo++) set[lo>>3] |= 1<<(lo&7);
+}
+
+static int rx_lit(struct rxparse *p, int c)
+{
+  int t = rx_set(p);
+
+  rx_range(p, t, c, c);
+  if (p->icase) {
+    rx_range(p, t, tolower(c), tolower(c));
+    rx_range(p, t, toupper(c), toupper(c));
+  }
+
+  return t;
+}
+
+// Any one character: ascii is a set of allowed single byte characters, plus
+// any UTF-8 sequence.
+static int rx_utf8(struct rxparse *p, int ascii)
+{
+  int i, j, t, cont;
+
+  for (i = 0; i<3; i++) {
+    rx_range(p, t = rx_set(p), "\xc2\xe0\xf0"[i]&255, "\xdf\xef\xf4"[i]&255);
+    for (j = 0; j<=i; j++) {
+      rx_range(p, cont = rx_set(p), 0x80, 0xbf);
+      t = rx_tree(p, RX_CAT, t, cont);
+    }
+    ascii = rx_tree(p, RX_ALT, ascii, t);
+  }
+
+  return ascii;
+}
+
+// Literal character. A UTF-8 sequence stays together so it repeats as one.
+static int rx_char(struct rxparse *p, int c)
+{
+  int t = rx_lit(p, c);
+
+  if (p->utf8 && c>127) {
+    if (p->icase) return rx_fail(p);
+    while ((*p->s&0xc0) == 0x80)
+      t = rx_tree(p, RX_CAT, t, rx_lit(p, *(unsigned char *)p->s++));
+  }
+
+  return t;
+}
+
+// Parse bracket expression after the [
+static int rx_bracket(struct rxparse *p)
+{
+  char *classes[] = {"alnum", "alpha", "blank", "cntrl", "digit", "graph",
+    "lower", "print", "punct", "space", "upper", "xdigit"}, *s = p->s, *set;
+  int (*is[])(int) = {isalnum, isalpha, isblank, iscntrl, isdigit, isgraph,
+    islower, isprint, ispunct, isspace, isupper, isxdigit};
+  int t = rx_set(p), neg = 0, first = 1, c, hi, i;
+
+  if (*s == '^') neg = *s++;
+  for (;; first = 0) {
+    if (!(c = *(unsigned char *)s)) return rx_fail(p);
+    if (c == ']' && !first) break;
+    if (c == '[' && (s[1] == '.' || s[1] == '=')) return rx_fail(p);
+
+    // Multibyte locales have non-ASCII letters and such, so leave it to libc.
+    if (c == '[' && s[1] == ':') {
+      char *end = strstr(s += 2, ":]");
+
+      if (!end || p->utf8) return rx_fail(p);
+      for (i = 0; i<ARRAY_LEN(classes); i++)
+        if (strlen(classes[i]) == end-s && !strncmp(classes[i], s, end-s))
+          break;
+      if (i == ARRAY_LEN(classes)) return rx_fail(p);
+      for (c = 1; c<256; c++) if (is[i](c)) rx_range(p, t, c, c);
+      s = end+2;
+
+      continue;
+    }
+    if (*++s == '-' && s[1] && s[1] != ']') {
+      hi = *(unsigned char *)++s;
+      if (hi == '[') return rx_fail(p);
+      s++;
+    } else hi = c;
+    if (hi<c || (p->utf8 && hi>127)) return rx_fail(p);
+    rx_range(p, t, c, hi);
+  }
+  p->s = s+1;
+
+  set = p->sets+32*p->tree[t].set;
+  if (p->icase) for (c = 1; c<256; c++) if (set[c>>3] & (1<<(c&7))) {
+    rx_range(p, t, tolower(c), tolower(c));
+    rx_range(p, t, toupper(c), toupper(c));
+  }
+  if (neg) {
+    for (i = 0; i<32; i++) set[i] = ~set[i];
+    *set &= ~1;
+    if (p->utf8) {
+      memset(set+16, 0, 16);
+      t = rx_utf8(p, t);
+    }
+  }
+
+  return t;
+}
+
+// Parse {min,max} (already past the { or \{)
+static void rx_interval(struct rxparse *p, int *min, int *max)
+{
+  char *s = p->s;
+
+  if (!isdigit(*s) && *s != ',') return (void)rx_fail(p);
+  *min = strtol(s, &s, 10);
+  if (*s == ',') *max = isdigit(*++s) ? strtol(s, &s, 10) : -1;
+  else *max = *min;
+  if (!strstart(&s, p->ere ? "}" : "\\}") || *min>255 || *max>255
+    || (*max != -1 && *max<*min)) return (void)rx_fail(p);
+  p->s = s;
+}
+
+static int rx_alt(struct rxparse *p);
+
+// Parse a branch: concatenated atoms with their repeat counts.
+static int rx_cat(struct rxparse *p)
+{
+  int cat = -1, first = 1, atom, c, min = 0, max = 0;
+
+  while ((c = *(unsigned char *)p->s)) {
+    char *s = p->s++;
+
+    if (p->ere ? c == '|' || (c == ')' && p->depth)
+      : c == '\\' && (s[1] == '|' || (s[1] == ')' && p->depth)))
+    {
+      p->s--;
+      break;
+    }
+
+    if (c == '.') {
+      atom = rx_set(p);
+      rx_range(p, atom, 1, p->utf8 ? 127 : 255);
+      if (p->utf8) atom = rx_utf8(p, atom);
+    } else if (c == '[') atom = rx_bracket(p);
+    else if (c == '^' && (p->ere || first)) atom = rx_tree(p, RX_BOL, 0, 0);
+    else if (c == '$' && (p->ere || !*p->s || (*p->s == '\\'
+      && (p->s[1] == ')' || p->s[1] == '|')))) atom = rx_tree(p, RX_EOL, 0, 0);
+    else if (p->ere ? c == '(' : c == '\\' && *p->s == '(') {
+      p->s += !p->ere;
+      p->depth++;
+      atom = rx_alt(p);
+      if (!strstart(&p->s, p->ere ? ")" : "\\)")) return rx_fail(p);
+      p->depth--;
+    } else if (p->ere && strchr("*+?{)", c)) return rx_fail(p);
+    else if (c == '\\') {
+      c = *(unsigned char *)p->s++;
+      // Backreferences and GNU extensions (\w, \<, \` and such) need libc
+      if (!c || isalnum(c) || strchr("<>`'", c)
+        || (!p->ere && strchr("{}|+?)", c))) return rx_fail(p);
+      atom = rx_lit(p, c);
+    } else atom = rx_char(p, c);
+    if (p->fail) return 0;
+
+    // A BRE's * after a leading ^ is literal, an ERE's is an error. Anchors
+    // inside groups get glibc-specific treatment, so leave those to libc.
+    if (p->tree[atom].type == RX_BOL || p->tree[atom].type == RX_EOL) {
+      if (p->depth || (p->ere && *p->s && strchr("*+?{", *p->s)))
+        return rx_fail(p);
+    } else for (;;) {
+      s = p->s;
+      if (*s == '*') min = 0, max = -1;
+      else if (p->ere ? *s == '+' : !strncmp(s, "\\+", 2)) min = 1, max = -1;
+      else if (p->ere ? *s == '?' : !strncmp(s, "\\?", 2)) min = 0, max = 1;
+      else if (!(p->ere ? *s == '{' : !strncmp(s, "\\{", 2))) break;
+      p->s += 1+(*s == '\\');
+      if (s[*s == '\\'] == '{') rx_interval(p, &min, &max);
+      atom = rx_tree(p, RX_REP, atom, 0);
+      p->tree[atom].min = min;
+      p->tree[atom].max = max;
+    }
+    if (p->fail) return 0;
+    cat = (cat<0) ? atom : rx_tree(p, RX_CAT, cat, atom);
+    first = 0;
+  }
+
+  return (cat<0) ? rx_tree(p, RX_EMPTY, 0, 0) : cat;
+}
+
+static int rx_alt(struct rxparse *p)
+{
+  int alt = rx_cat(p);
+
+  while (p->ere ? *p->s == '|' : !strncmp(p->s, "\\|", 2)) {
+    p->s += 1+!p->ere;
+    alt = rx_tree(p, RX_ALT, alt, rx_cat(p));
+  }
+
+  return alt;
+}
+
+static int rx_node(struct rxprog *prog, struct rxdfa *d, int type, int out,
+  int out1, int set)
+{
+  struct rxnode *n;
+
+  if (d->nnode == RX_MAXNODE) return prog->fail++;
+  if (!(d->nnode&255))
+    d->node = xrealloc(d->node, (d->nnode+256)*sizeof(struct rxnode));
+  n = d->node+d->nnode;
+  n->type = type;
+  n->out = out;
+  n->out1 = out1;
+  n->set = set;
+
+  return d->nnode++;
+}
+
+// Build NFA for tree node t continuing to node next, backwards if rev.
+static int rx_compile(struct rxprog *prog, struct rxparse *p, struct rxdfa *d,
+  int t, int next, int rev)
+{
+  struct rxtree *tt = p->tree+t;
+  int i, n, done = next;
+
+  if (prog->fail) return 0;
+  if (tt->type == RX_SET) return rx_node(prog, d, RX_SET, next, 0, tt->set);
+  if (tt->type == RX_BOL || tt->type == RX_EOL)
+    return rx_node(prog, d, (tt->type == RX_BOL) == !rev ? RX_BOL : RX_EOL,
+      next, 0, 0);
+  if (tt->type == RX_CAT) {
+    next = rx_compile(prog, p, d, rev ? tt->a : tt->b, next, rev);
+    return rx_compile(prog, p, d, rev ? tt->b : tt->a, next, rev);
+  }
+  if (tt->type == RX_ALT) {
+    i = rx_compile(prog, p, d, tt->a, next, rev);
+    n = rx_compile(prog, p, d, tt->b, next, rev);
+
+    return rx_node(prog, d, RX_SPLIT, i, n, 0);
+  }
+  if (tt->type == RX_REP) {
+    // a{min,} is min copies then a loop, a{min,max} nests optional copies.
+    if (tt->max<0) {
+      next = rx_node(prog, d, RX_SPLIT, 0, done, 0);
+      i = rx_compile(prog, p, d, tt->a, next, rev);
+      if (!prog->fail) d->node[next].out = i;
+    } else for (i = tt->min; i<tt->max; i++) {
+      n = rx_compile(prog, p, d, tt->a, next, rev);
+      next = rx_node(prog, d, RX_SPLIT, n, done, 0);
+    }
+    for (i = 0; i<tt->min; i++) next = rx_compile(prog, p, d, tt->a, next, rev);
+  }
+
+  return next;
+}
+
+// Add node n and everything reachable from it without consuming input to
+// d->tmp, following ^ if bol.
+static void rx_closure(struct rxdfa *d, int n, int bol)
+{
+  int sp = 0;
+
+  d->stack[sp++] = n;
+  while (sp) {
+    struct rxnode *node = d->node+(n = d->stack[--sp]);
+
+    if (d->mark[n] == d->gen) continue;
+    d->mark[n] = d->gen;
+    if (node->type == RX_SPLIT) {
+      d->stack[sp++] = node->out1;
+      d->stack[sp++] = node->out;
+    } else if (node->type == RX_BOL) {
+      if (bol) d->stack[sp++] = node->out;
+    } else d->tmp[d->ntmp++] = n;
+  }
+}
+
+// Would this set of nodes match if the string ended here?
+static int rx_eolmatch(struct rxdfa *d, int *set, int len, int flags)
+{
+  int sp = 0, n;
+
+  d->gen++;
+  while (len--) if (d->node[set[len]].type == RX_EOL) d->stack[sp++] = set[len];
+  while (sp) {
+    struct rxnode *node = d->node+(n = d->stack[--sp]);
+
+    if (d->mark[n] == d->gen) continue;
+    d->mark[n] = d->gen;
+    if (node->type == RX_MATCH) return 1;
+    if (node->type == RX_SPLIT) d->stack[sp++] = node->out1;
+    if (node->type == RX_SPLIT || node->type == RX_EOL
+      || (node->type == RX_BOL && (flags & RXS_BOL)))
+        d->stack[sp++] = node->out;
+  }
+
+  return 0;
+}
+
+// Forget all DFA states.
+static void rx_flush(struct rxdfa *d)
+{
+  d->nstate = d->npool = 0;
+  memset(d->hash, 0, 2*RX_MAXSTATE*sizeof(int));
+  memset(d->begin, -1, sizeof(d->begin));
+  d->flushes++;
+}
+
+static int rx_intcmp(const void *a, const void *b)
+{
+  return *(int *)a - *(int *)b;
+}
+
+// Find or add the DFA state for the node set in d->tmp.
+static int rx_state(struct rxprog *prog, struct rxdfa *d, int flags)
+{
+  int *set = d->tmp, len = d->ntmp, i, j;
+  unsigned h = flags;
+
+  qsort(set, len, sizeof(int), rx_intcmp);
+  for (i = 0; i<len; i++) h = (h^set[i])*16777619;
+  for (h %= 2*RX_MAXSTATE; (i = d->hash[h]); h = (h+1)%(2*RX_MAXSTATE)) {
+    i--;
+    if ((d->stflags[i]&3) == flags && d->stlen[i] == len
+      && !memcmp(d->pool+d->stset[i], set, len*sizeof(int))) return i;
+  }
+
+  if (d->nstate == RX_MAXSTATE || d->npool+len > RX_MAXPOOL) {
+    rx_flush(d);
+
+    return rx_state(prog, d, flags);
+  }
+  if (d->npool+len > d->maxpool) {
+    d->maxpool = 2*(d->npool+len);
+    d->pool = xrealloc(d->pool, d->maxpool*sizeof(int));
+  }
+  d->hash[h] = (i = d->nstate++)+1;
+  memcpy(d->pool+(d->stset[i] = d->npool), set, len*sizeof(int));
+  d->npool += d->stlen[i] = len;
+  for (j = 0; j<len; j++) if (d->node[set[j]].type == RX_MATCH) break;
+  d->stflags[i] = flags | RXS_MATCH*(j<len)
+    | RXS_EOLMATCH*rx_eolmatch(d, set, len, flags)
+    | RXS_DEAD*!(len || (flags&RXS_FLOAT));
+  memset(d->next+i*prog->ncls, -1, prog->ncls*sizeof(int));
+
+  return i;
+}
+
+// Starting state, cached.
+static int rx_begin(struct rxprog *prog, struct rxdfa *d, int flags)
+{
+  if (d->begin[flags]<0) {
+    d->gen++;
+    d->ntmp = 0;
+    rx_closure(d, d->start, flags&RXS_BOL);
+    d->begin[flags] = rx_state(prog, d, flags);
+  }
+
+  return d->begin[flags];
+}
+
+// Work out (and remember) the state after st consumes byte c.
+static int rx_step(struct rxprog *prog, struct rxdfa *d, int st, int c)
+{
+  int *set = d->pool+d->stset[st], len = d->stlen[st],
+      flags = d->stflags[st]&RXS_FLOAT, flushes = d->flushes, i;
+
+  d->gen++;
+  d->ntmp = 0;
+  for (i = 0; i<len; i++) {
+    struct rxnode *node = d->node+set[i];
+
+    if (node->type == RX_SET && (prog->sets[32*node->set+(c>>3)] & (1<<(c&7))))
+      rx_closure(d, node->out, 0);
+  }
+  if (flags) rx_closure(d, d->start, 0);
+  i = rx_state(prog, d, flags);
+  if (flushes == d->flushes) d->next[st*prog->ncls+prog->cls[c]] = i;
+
+  return i;
+}
+
+static void rx_init(struct rxprog *prog, struct rxparse *p, struct rxdfa *d,
+  int root, int rev)
+{
+  d->start = rx_compile(prog, p, d, root, rx_node(prog, d, RX_MATCH, 0, 0, 0),
+    rev);
+  if (prog->fail) return;
+  d->mark = xzalloc(d->nnode*sizeof(int));
+  d->stack = xmalloc((2*d->nnode+1)*sizeof(int));
+  d->tmp = xmalloc(d->nnode*sizeof(int));
+  d->stset = xmalloc(RX_MAXSTATE*sizeof(int));
+  d->stlen = xmalloc(RX_MAXSTATE*sizeof(int));
+  d->stflags = xmalloc(RX_MAXSTATE);
+  d->next = xmalloc(RX_MAXSTATE*prog->ncls*sizeof(int));
+  d->hash = xmalloc(2*RX_MAXSTATE*sizeof(int));
+  rx_flush(d);
+}
+
+static void rx_free(struct rxdfa *d)
+{
+  free(d->node);
+  free(d->mark);
+  free(d->stack);
+  free(d->tmp);
+  free(d->pool);
+  free(d->stset);
+  free(d->stlen);
+  free(d->stflags);
+  free(d->next);
+  free(d->hash);
+}
+
+// Parse regex, returning NULL if it needs libc.
+static struct rxprog *rx_new(char *regex, int cflags)
+{
+  struct rxparse p;
+  struct rxprog *prog;
+  int root, i, j, k, map[512];
+
+  memset(&p, 0, sizeof(p));
+  p.s = regex;
+  p.ere = cflags & REG_EXTENDED;
+  p.icase = cflags & REG_ICASE;
+  p.utf8 = MB_CUR_MAX>1;
+  root = rx_alt(&p);
+  if (*p.s) rx_fail(&p);
+  if (p.fail) {
+    free(p.tree);
+    free(p.sets);
+
+    return 0;
+  }
+
+  // Bytes that are in the same sets act the same, so share transitions.
+  prog = xzalloc(sizeof(struct rxprog));
+  prog->sets = p.sets;
+  prog->cflags = cflags;
+  prog->ncls = 1;
+  for (i = 0; i<p.nsets; i++) {
+    memset(map, -1, sizeof(map));
+    for (j = k = 0; j<256; j++) {
+      int c = 2*prog->cls[j] + !!(p.sets[32*i+(j>>3)] & (1<<(j&7)));
+
+      if (map[c]<0) map[c] = k++;
+      prog->cls[j] = map[c];
+    }
+    prog->ncls = k;
+  }
+
+  rx_init(prog, &p, &prog->fwd, root, 0);
+  rx_init(prog, &p, &prog->rev, root, 1);
+  free(p.tree);
+  if (prog->fail) {
+    rx_free(&prog->fwd);
+    rx_free(&prog->rev);
+    free(prog->sets);
+    free(prog);
+
+    return 0;
+  }
+
+  return prog;
+}
+
+// Like regcomp(), but also build a DFA matcher if the regex allows it.
+int regdfa_comp(struct regdfa *rd, char *regex, int cflags)
+{
+  int rc = regcomp(&rd->re, regex, cflags);
+
+  rd->prog = (rc || (cflags & REG_NEWLINE)) ? 0 : rx_new(regex, cflags);
+
+  return rc;
+}
+
+// Like regexec()
+int regdfa_exec(struct regdfa *rd, char *s, size_t nmatch, regmatch_t *pm,
+  int eflags)
+{
+  struct rxprog *prog = rd->prog;
+  struct rxdfa *d;
+  unsigned char *us = (void *)s;
+  int st, bol = !(eflags & REG_NOTBOL), eol = !(eflags & REG_NOTEOL), n;
+  long len, i, start, end;
+
+  if (!prog) return regexec(&rd->re, s, nmatch, pm, eflags);
+  if (prog->cflags & REG_NOSUB) nmatch = 0;
+  len = strlen(s);
+
+  // Is there a match at all?
+  d = &prog->fwd;
+  st = rx_begin(prog, d, RXS_FLOAT|RXS_BOL*bol);
+  for (i = 0; !(d->stflags[st] & RXS_MATCH); st = n) {
+    if (i == len) {
+      if (eol && (d->stflags[st] & RXS_EOLMATCH)) break;
+
+      return REG_NOMATCH;
+    }
+    if ((n = d->next[st*prog->ncls+prog->cls[us[i]]])<0)
+      n = rx_step(prog, d, st, us[i]);
+    i++;
+  }
+  if (!nmatch) return 0;
+
+  // Subexpression offsets need libc.
+  if (nmatch>1 && rd->re.re_nsub) return regexec(&rd->re, s, nmatch, pm, eflags);
+
+  // Leftmost start: run the reversed regex back from the end.
+  d = &prog->rev;
+  st = rx_begin(prog, d, RXS_FLOAT|RXS_BOL*eol);
+  start = (d->stflags[st] & RXS_MATCH) ? len : -1;
+  for (i = len; i--;) {
+    if ((n = d->next[st*prog->ncls+prog->cls[us[i]]])<0)
+      n = rx_step(prog, d, st, us[i]);
+    if (d->stflags[st = n] & RXS_MATCH) start = i;
+  }
+  if (bol && (d->stflags[st] & RXS_EOLMATCH)) start = 0;
+
+  // Longest end from there.
+  d = &prog->fwd;
+  st = rx_begin(prog, d, RXS_BOL*(bol && !start));
+  end = (d->stflags[st] & RXS_MATCH) ? start : -1;
+  for (i = start; i<len; i++) {
+    if ((n = d->next[st*prog->ncls+prog->cls[us[i]]])<0)
+      n = rx_step(prog, d, st, us[i]);
+    if (d->stflags[st = n] & RXS_DEAD) break;
+    if (d->stflags[st] & RXS_MATCH) end = i+1;
+  }
+  if (i == len && eol && (d->stflags[st] & RXS_EOLMATCH)) end = len;
+
+  if (start<0 || end<0) return regexec(&rd->re, s, nmatch, pm, eflags);
+  for (i = 0; i<nmatch; i++) pm[i].rm_so = pm[i].rm_eo = -1;
+  pm->rm_so = start;
+  pm->rm_eo = end;
+
+  return 0;
+}
+
+// regdfa_comp() that dies on failure, like xregcomp()
+void xregdfa(struct regdfa *rd, char *regex, int cflags)
+{
+  int rc = regdfa_comp(rd, regex, cflags);
+
+  if (rc) {
+    regerror(rc, &rd->re, libbuf, sizeof(libbuf));
+    error_exit("xregcomp: %s", libbuf);
+  }
+}
+
+void regdfa_free(struct regdfa *rd)
+{
+  struct rxprog *prog = rd->prog;
+
+  regfree(&rd->re);
+  if (prog) {
+    rx_free(&prog->fwd);
+    rx_free(&prog->rev);
+    free(prog->sets);
+    free(prog);
+  }
+}
@@ -8,6 +8,7 @@
  */
 
 #include "toys.h"
+#include <sys/syscall.h>
 
 // strcpy and strncat with size checking. Size is the total space in "dest",
 // including null terminator. Exit if there's not enough space for the string
@@ -41,6 +42,7 @@ void *xmalloc(size_t size)
 {
   void *ret = malloc(size);
   if (!ret) error_exit("xmalloc");
+  if (CFG_TOYBOX_STATS) TOYSTAT(allocs, 1);
 
   return ret;
 }
@@ -59,6 +61,7 @@ void *xrealloc(void *ptr, size_t size)
 {
   ptr = realloc(ptr, size);
   if (!ptr) error_exit("xrealloc");
+  if (CFG_TOYBOX_STATS) TOYSTAT(reallocs, 1);
 
   return ptr;
 }
@@ -69,6 +72,7 @@ char *xstrndup(char *s, size_t n)
   char *ret = strndup(s, ++n);
 
   if (!ret) error_exit("xstrndup");
+  if (CFG_TOYBOX_STATS) TOYSTAT(allocs, 1);
   ret[--n] = 0;
 
   return ret;
@@ -250,6 +254,7 @@ int xcreate(char *path, int flags, int mode)
 {
   int fd = open(path, flags^O_CLOEXEC, mode);
   if (fd == -1) perror_exit("%s", path);
+  if (CFG_TOYBOX_STATS) TOYSTAT(opens, 1);
   return fd;
 }
 
@@ -262,6 +267,7 @@ int xopen(char *path, int flags)
 void xclose(int fd)
 {
   if (close(fd)) perror_exit("xclose");
+  if (CFG_TOYBOX_STATS) TOYSTAT(closes, 1);
 }
 
 int xdup(int fd)
@@ -269,6 +275,7 @@ int xdup(int fd)
   if (fd != -1) {
     fd = dup(fd);
     if (fd == -1) perror_exit("xdup");
+    if (CFG_TOYBOX_STATS) TOYSTAT(opens, 1);
   }
   return fd;
 }
@@ -295,6 +302,10 @@ size_t xread(int fd, void *buf, size_t len)
 {
   ssize_t ret = read(fd, buf, len);
   if (ret < 0) perror_exit("xread");
+  if (CFG_TOYBOX_STATS) {
+    TOYSTAT(reads, 1);
+    TOYSTAT(rbytes, ret);
+  }
 
   return ret;
 }
@@ -319,6 +330,7 @@ off_t xlseek(int fd, off_t offset, int whence)
 {
   offset = lseek(fd, offset, whence);
   if (offset<0) perror_exit("lseek");
+  if (CFG_TOYBOX_STATS) TOYSTAT(seeks, 1);
 
   return offset;
 }
@@ -609,18 +621,54 @@ void xpidfile(char *name)
   close(fd);
 }
 
+// Count bytes the kernel copied for us as both read and written.
+static long sent(long len)
+{
+  if (CFG_TOYBOX_STATS && len>0) {
+    TOYSTAT(reads, 1);
+    TOYSTAT(writes, 1);
+    TOYSTAT(rbytes, len);
+    TOYSTAT(wbytes, len);
+  }
+
+  return len;
+}
+
 // Copy the rest of in to out and close both files.
 
 void xsendfile(int in, int out)
 {
-  long len;
+  struct stat sti, sto;
+  long len = -1, max = 1<<30;
+  char *buf;
 
   if (in<0) return;
-  for (;;) {
-    len = xread(in, libbuf, sizeof(libbuf));
-    if (len<1) break;
-    xwrite(out, libbuf, len);
+
+  // Let the kernel copy where it can: copy_file_range() between files on the
+  // same filesystem (which can reflink or copy server side, and older kernels
+  // silently copy nothing from /proc across filesystems), sendfile() from a
+  // file to anything, and splice() when either end is a pipe. These use and
+  // advance the file positions, so if one fails partway the loop below picks
+  // up from there.
+  if (!fstat(in, &sti) && !fstat(out, &sto)) {
+#ifdef __NR_copy_file_range
+    if (S_ISREG(sti.st_mode) && S_ISREG(sto.st_mode)
+        && sti.st_dev == sto.st_dev)
+      while (0<(len = sent(syscall(__NR_copy_file_range, in, 0, out, 0, max, 0))));
+#endif
+    if (len && S_ISREG(sti.st_mode))
+      while (0<(len = sent(syscall(__NR_sendfile, out, in, 0, max))));
+#ifdef __NR_splice
+    if (len && (S_ISFIFO(sti.st_mode) || S_ISFIFO(sto.st_mode)))
+      while (0<(len = sent(syscall(__NR_splice, in, 0, out, 0, max, 0))));
+#endif
+    if (!len) return;
   }
+
+  // Fall back to read/write, through a bigger buffer than libbuf.
+  buf = xmalloc(65536);
+  while (0<(len = xread(in, buf, 65536))) xwrite(out, buf, len);
+  free(buf);
 }
 
 // parse fractional seconds with optional s/m/h/d suffix
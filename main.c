@@ -24,34 +24,40 @@ struct toy_list toy_list[] = {
 // global context for this command.
 
 struct toy_context toys;
+struct toy_stats toystats;
 union global_union this;
 char toybuf[4096], libbuf[4096];
 
+// Perfect hash table generated by scripts/mkhash.c from the enabled commands
+
+#include "generated/toyhash.h"
+
+// Must match hash() in scripts/mkhash.c
+static unsigned toy_hash(char *s, unsigned seed)
+{
+  unsigned h = 2166136261U^seed;
+
+  while (*s) h = (h^*(unsigned char *)s++)*16777619;
+
+  return h^(h>>15);
+}
+
 struct toy_list *toy_find(char *name)
 {
-  int top, bottom, middle;
+  int i;
 
   if (!CFG_TOYBOX) return 0;
 
-  // If the name starts with "toybox" accept that as a match.  Otherwise
-  // skip the first entry, which is out of order.
+  // If the name starts with "toybox" accept that as a match.
 
   if (!strncmp(name,"toybox",6)) return toy_list;
-  bottom = 1;
 
-  // Binary search to find this command.
+  // One slot per name, so one strcmp() says whether this is a command.
 
-  top = ARRAY_LEN(toy_list)-1;
-  for (;;) {
-    int result;
+  i = toy_hash_disp[toy_hash(name, 0)&(TOYHASH_BUCKETS-1)];
+  i = toy_hash_table[toy_hash(name, i)&(TOYHASH_SIZE-1)];
 
-    middle = (top+bottom)/2;
-    if (middle<bottom || middle>top) return NULL;
-    result = strcmp(name,toy_list[middle].name);
-    if (!result) return toy_list+middle;
-    if (result<0) top=--middle;
-    else bottom = ++middle;
-  }
+  return (i && !strcmp(name, toy_list[i].name)) ? toy_list+i : 0;
 }
 
 // Figure out whether or not anything is using the option parsing logic,
@@ -147,6 +153,54 @@ void toy_exec(char *argv[])
   xexit();
 }
 
+// TOYBOX_STATS: report resource use when this process exits.
+
+static struct {
+  char *where;
+  struct timespec start;
+  pid_t pid;
+} stats;
+
+static void stats_report(void)
+{
+  struct rusage ru;
+  struct timespec now;
+  char buf[512];
+  int fd = 2, len;
+
+  // Forked children that exit() without exec() aren't us
+  if (getpid() != stats.pid) return;
+  getrusage(RUSAGE_SELF, &ru);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  len = snprintf(buf, sizeof(buf), "toybox stats: %s exit=%d wall=%.3f "
+    "user=%.3f sys=%.3f maxrss=%ldk read=%lld/%ld write=%lld/%ld open=%ld "
+    "close=%ld seek=%ld malloc=%ld realloc=%ld\n",
+    toys.which ? toys.which->name : "toybox", toys.exitval,
+    (now.tv_sec-stats.start.tv_sec)+(now.tv_nsec-stats.start.tv_nsec)/1e9,
+    ru.ru_utime.tv_sec+ru.ru_utime.tv_usec/1e6,
+    ru.ru_stime.tv_sec+ru.ru_stime.tv_usec/1e6, ru.ru_maxrss,
+    toystats.rbytes, toystats.reads, toystats.wbytes, toystats.writes,
+    toystats.opens, toystats.closes, toystats.seeks, toystats.allocs,
+    toystats.reallocs);
+
+  // One write() so lines from concurrent processes don't interleave
+  if (strcmp(stats.where, "-"))
+    fd = open(stats.where, O_WRONLY|O_APPEND|O_CREAT|O_CLOEXEC, 0644);
+  if (fd != -1) {
+    writeall(fd, buf, len);
+    if (fd != 2) close(fd);
+  }
+}
+
+static void stats_start(char *where)
+{
+  if (stats.where) return;
+  stats.where = where;
+  stats.pid = getpid();
+  clock_gettime(CLOCK_MONOTONIC, &stats.start);
+  atexit(stats_report);
+}
+
 // Multiplexer command, first argument is command to run, rest are args to that.
 // If first argument starts with - output list of command install paths.
 
@@ -156,6 +210,10 @@ void toybox_main(void)
   int i, len = 0;
 
   toys.which = toy_list;
+  if (CFG_TOYBOX_STATS && toys.argv[1] && !strcmp(toys.argv[1], "--stats")) {
+    stats_start("-");
+    toys.optargs = ++toys.argv+1;
+  }
   if (toys.argv[1]) {
     toys.optc = toys.recursion = 0;
     toy_exec(toys.argv+1);
@@ -185,9 +243,13 @@ void toybox_main(void)
 
 int main(int argc, char *argv[])
 {
+  char *s;
+
   // We check our own stdout errors, disable sigpipe killer
   signal(SIGPIPE, SIG_IGN);
 
+  if (CFG_TOYBOX_STATS && (s = getenv("TOYBOX_STATS")) && *s) stats_start(s);
+
   if (CFG_TOYBOX) {
     // Trim path off of command name
     *argv = basename(*argv);
@@ -0,0 +1,186 @@
+#!/bin/bash
+
+# Time common commands on generated input, to catch performance regressions.
+#
+# usage: bench.sh [old] new
+#
+# With two binaries, runs each benchmark on both and shows the change.
+# BENCH_SCALE multiplies input sizes (default 1), BENCH_RUNS is how many
+# times to run each benchmark keeping the fastest (default 3), BENCH_ONLY
+# is a list of benchmark names to run (default all).
+
+if [ $# -lt 1 ] || [ $# -gt 2 ]
+then
+  echo "usage: bench.sh [old] new" >&2
+  exit 1
+fi
+
+[ -z "$TOPDIR" ] && TOPDIR="$(pwd)"
+SCALE=${BENCH_SCALE:-1}
+RUNS=${BENCH_RUNS:-3}
+BENCHDIR="$TOPDIR/generated/benchdir"
+export LC_ALL=C
+
+for i in "$@"
+do
+  [ -x "$i" ] || { echo "no $i" >&2; exit 1; }
+done
+OLD=$([ $# -eq 2 ] && readlink -f "$1")
+NEW=$(readlink -f "${!#}")
+
+# Microseconds since epoch
+now()
+{
+  if [ -n "$EPOCHREALTIME" ]
+  then
+    echo $((${EPOCHREALTIME/[.,]/}))
+  else
+    echo $(($(date +%s%N)/1000))
+  fi
+}
+
+# Deterministic input (Park-Miller random numbers in awk, so it comes out
+# the same with any awk), regenerated when BENCH_SCALE changes.
+
+generate()
+{
+  [ "$(cat "$BENCHDIR/scale" 2>/dev/null)" == "$SCALE" ] && return
+  echo "Generating input in $BENCHDIR" >&2
+  rm -rf "$BENCHDIR" && mkdir -p "$BENCHDIR" && cd "$BENCHDIR" || exit 1
+
+  # Text: 200k lines (per SCALE) of words and numbers, about 14 megabytes
+  awk -v lines=$((200000*SCALE)) 'BEGIN {
+    n = split("the of and to in is was that for it with as his on be at by " \
+      "this had not are but from or have an they which one you were her all " \
+      "she there would their we him been has when who will more no if out " \
+      "kernel toybox posix linux error warning buffer socket thread mutex " \
+      "compress inflate deflate checksum directory symlink hardlink inode", w)
+    x = 42
+    for (i = 0; i<lines; i++) {
+      x = (x*16807)%2147483647; len = 3+x%12; line = ""
+      for (j = 0; j<len; j++) {
+        x = (x*16807)%2147483647
+        line = line (j ? " " : "") (x%7 ? w[1+x%n] : x%100000)
+      }
+      print line
+    }
+  }' > text
+
+  # Random bytes (incompressible), 4 megabytes per SCALE
+  awk -v len=$((4*1048576*SCALE)) 'BEGIN {
+    x = 7
+    for (i = 0; i<len; i+=256) {
+      s = ""
+      for (j = 0; j<256; j++) {
+        x = (x*16807)%2147483647
+        s = s sprintf("%c", x%256)
+      }
+      printf "%s", s
+    }
+  }' > random
+
+  # Directory tree: 10*10*10 directories (per SCALE at top) of 20 files each,
+  # two of which are also hardlinked into the parent directory.
+  awk -v top=$((10*SCALE)) 'BEGIN {
+    for (a = 0; a<top; a++) for (b = 0; b<10; b++) for (c = 0; c<10; c++)
+      print "tree/" a "/" b "/" c
+  }' | xargs mkdir -p
+  for dir in tree/*/*/*
+  do
+    for i in $(seq 1 20)
+    do
+      head -c $((i*97)) text > $dir/file$i
+    done
+    for i in 1 11
+    do
+      ln $dir/file$i $dir.link$i
+    done
+  done
+
+  echo $SCALE > scale
+}
+
+# Run command line $1 in benchdir (with $TB set to the toybox binary) RUNS
+# times, setting TIME to the fastest run in microseconds (or "fail").
+
+timeit()
+{
+  local i start end
+
+  TIME=
+  for i in $(seq 1 $RUNS)
+  do
+    rm -rf "$BENCHDIR/out"
+    start=$(now)
+    (cd "$BENCHDIR" && eval "$1") > /dev/null 2>&1 || { TIME=fail; return; }
+    end=$(now)
+    [ -z "$TIME" ] || [ $((end-start)) -lt $TIME ] && TIME=$((end-start))
+  done
+}
+
+# Print microseconds $3 as seconds, and rate of $2 (bytes for unit $1 of
+# MB/s, else count) per second.
+rate()
+{
+  [ "$3" == fail ] && { printf "%10s %12s" FAIL -; return; }
+  awk -v t=$3 -v n=$2 -v mb=$([ "$1" == MB/s ] && echo 1048576 || echo 1) \
+    'BEGIN { printf "%10.3f %12.1f", t/1000000, t ? n*1000000/t/mb : 0 }'
+}
+
+# bench NAME UNIT AMOUNT COMMAND (which uses $TB for the toybox binary)
+bench()
+{
+  local name=$1 unit=$2 amount=$3 cmd="$4"
+
+  [ -n "$BENCH_ONLY" ] && ! echo " $BENCH_ONLY " | grep -q " $name " && return
+  if ! "$NEW" | tr ' ' '\n' | grep -qx "$(echo "$cmd" | awk '{print $2}')"
+  then
+    printf "%-14s disabled\n" $name
+    return
+  fi
+
+  TB="$NEW" timeit "$cmd"
+  NEWTIME=$TIME
+  printf "%-14s %-7s %s" $name $unit "$(rate $unit $amount $NEWTIME)"
+  if [ -n "$OLD" ]
+  then
+    TB="$OLD" timeit "$cmd"
+    printf " %s" "$(rate $unit $amount $TIME)"
+    if [ "$TIME" != fail ] && [ "$NEWTIME" != fail ] && [ "$TIME" -ne 0 ]
+    then
+      printf " %+7.1f%%" $(awk -v o=$TIME -v n=$NEWTIME \
+        'BEGIN {print (o-n)*100/o}')
+    fi
+  fi
+  echo
+}
+
+generate
+cd "$BENCHDIR" || exit 1
+MB=$(wc -c < text)
+RMB=$(wc -c < random)
+FILES=$(find tree | wc -l)
+TREEMB=$(cat $(find tree -type f) | wc -c)
+
+printf "%-14s %-7s %10s %12s" name unit seconds rate
+[ -n "$OLD" ] && printf " %10s %12s %8s" "old sec" "old rate" speedup
+echo
+echo "-------------------------------------------------------------------------------"
+
+bench sort      MB/s $MB     '$TB sort text'
+bench sort-n    MB/s $MB     '$TB sort -n text'
+bench sort-k    MB/s $MB     '$TB sort -k3,3 -k1 text'
+bench grep      MB/s $MB     '$TB grep -c "mutex.*thread" text'
+bench grep-F    MB/s $MB     '$TB grep -cF -e socket -e inode text'
+bench grep-i    MB/s $MB     '$TB grep -ci "KERNEL" text'
+bench sed       MB/s $MB     '$TB sed "s/the/THE/g" text'
+bench wc        MB/s $MB     '$TB wc text'
+bench md5sum    MB/s $RMB    '$TB md5sum random'
+bench sha1sum   MB/s $RMB    '$TB sha1sum random'
+bench gzip-text MB/s $MB     '$TB gzip -c text'
+bench gzip-rand MB/s $RMB    '$TB gzip -c random'
+bench tar       files/s $FILES '$TB tar cf - tree'
+bench find      files/s $FILES '$TB find tree'
+bench find-name files/s $FILES '$TB find tree -name "file1*"'
+bench du        files/s $FILES '$TB du -s tree'
+bench cp        MB/s $TREEMB '$TB cp -a tree out'
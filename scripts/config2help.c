@@ -3,6 +3,7 @@
 // Humor toys.h
 struct toy_context toys;
 char libbuf[4096], toybuf[4096];
+struct toy_stats toystats;
 void show_help(void) {;}
 void toy_exec(char *argv[]) {;}
 
@@ -343,11 +344,13 @@ int main(int argc, char *argv[])
         free(cusage);
         free(tusage);
         throw->enabled = 0;
+        throw->help = 0;
         throw = catch;
         throw->help = anchor->prev->prev;
 
         throw = catch;
-        this = throw->help->data + throw->help_indent + 8 + len;
+        name = throw->help->data + throw->help_indent + 7;
+        this = name + len + 1;
       }
     }
 
@@ -93,7 +93,7 @@ then
   # for it.
 
   > generated/optlibs.dat
-  for i in util crypt m resolv selinux smack attr
+  for i in util crypt m resolv pthread selinux smack attr
   do
     echo "int main(int argc, char *argv[]) {return 0;}" | \
     ${CROSS_COMPILE}${CC} $CFLAGS -xc - -o /dev/null -Wl,--as-needed -l$i > /dev/null 2>/dev/null &&
@@ -180,6 +180,22 @@ do
 done | sort -s | sed -n 's/ A / /;t pair;h;s/\([^ ]*\).*/\1 " "/;x;b single;:pair;h;n;:single;s/[^ ]* B //;H;g;s/\n/ /;p' |\
 generated/mkflags > generated/flags.h || exit 1
 
+if [ generated/mkhash -ot scripts/mkhash.c ]
+then
+  do_loudly $HOSTCC scripts/mkhash.c -o generated/mkhash || exit 1
+fi
+
+echo -n "generated/toyhash.h "
+
+# Perfect hash of enabled command names (in toy_list[] order) for toy_find()
+
+(
+  echo "#define NEWTOY(aa,bb,cc) TOYNAME aa"
+  echo "#define OLDTOY(aa,bb,cc) TOYNAME aa"
+  cat generated/config.h generated/newtoys.h
+) | ${CROSS_COMPILE}${CC} -E - | sed -n 's/^TOYNAME //p' | \
+generated/mkhash > generated/toyhash.h || exit 1
+
 # Extract global structure definitions and flag definitions from toys/*/*.c
 
 function getglobals()
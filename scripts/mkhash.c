@@ -0,0 +1,94 @@
+// Take command names on stdin (one per line, in toy_list[] order) and
+// produce a collision-free hash table mapping each name to its toy_list[]
+// index, so toy_find() can look a name up with one strcmp().
+
+// Hash and displace: the first hash picks a bucket, each bucket gets a
+// displacement (seed for the second hash) found by trial so its names all
+// land in empty slots. The hash function must match toy_hash() in main.c.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned hash(char *s, unsigned seed)
+{
+  unsigned h = 2166136261U^seed;
+
+  while (*s) h = (h^*(unsigned char *)s++)*16777619;
+
+  return h^(h>>15);
+}
+
+int main(int argc, char *argv[])
+{
+  char *names[4096], line[256];
+  unsigned short *table, *disp;
+  int count = 0, size = 1, buckets, i, j, k, *order, *slots, *bucket, *len;
+
+  while (fgets(line, sizeof(line), stdin)) {
+    if (!(i = strcspn(line, "\n"))) continue;
+    line[i] = 0;
+    if (count == 4096) {
+      fprintf(stderr, "too many commands\n");
+      exit(1);
+    }
+    names[count++] = strdup(line);
+  }
+
+  // Slots: power of 2 at least twice the names. Buckets: a quarter of that.
+  while (size < 2*count) size <<= 1;
+  if ((buckets = size/4) < 1) buckets = 1;
+  table = calloc(size, sizeof(*table));
+  disp = calloc(buckets, sizeof(*disp));
+  order = calloc(buckets, sizeof(*order));
+  len = calloc(buckets, sizeof(*len));
+  slots = calloc(count+1, sizeof(*slots));
+  bucket = calloc(count+1, sizeof(*bucket));
+  for (k = 0; k<count; k++) len[bucket[k] = hash(names[k], 0)&(buckets-1)]++;
+
+  // Place the fullest buckets first, while there's the most room.
+  for (i = 0; i<buckets; i++) order[i] = i;
+  for (i = 0; i<buckets; i++) for (j = i+1; j<buckets; j++)
+    if (len[order[j]]>len[order[i]]) {
+      k = order[i];
+      order[i] = order[j];
+      order[j] = k;
+    }
+
+  // Entry 0 is the "toybox" multiplexer, which toy_find() handles by prefix,
+  // so table value 0 can mean empty.
+  for (i = 0; i<buckets; i++) {
+    int b = order[i], d, n;
+
+    for (d = 1; d<65536; d++) {
+      for (n = 0, k = 1; k<count; k++) {
+        if (bucket[k] != b) continue;
+        slots[n] = hash(names[k], d)&(size-1);
+        if (table[slots[n]]) break;
+        for (j = 0; j<n; j++) if (slots[j] == slots[n]) break;
+        if (j<n) break;
+        n++;
+      }
+      if (k == count) break;
+    }
+    if (d == 65536) {
+      fprintf(stderr, "no perfect hash\n");
+      exit(1);
+    }
+    disp[b] = d;
+    for (n = 0, k = 1; k<count; k++)
+      if (bucket[k] == b) table[slots[n++]] = k;
+  }
+
+  printf("#define TOYHASH_COUNT %d\n#define TOYHASH_SIZE %d\n"
+    "#define TOYHASH_BUCKETS %d\n\nstatic const unsigned short toy_hash_disp[]"
+    " = {", count, size, buckets);
+  for (i = 0; i<buckets; i++) printf("%s%d", i ? (i%16 ? "," : ",\n  ") : "\n  ",
+    disp[i]);
+  printf("\n};\n\nstatic const unsigned short toy_hash_table[] = {");
+  for (i = 0; i<size; i++) printf("%s%d", i ? (i%16 ? "," : ",\n  ") : "\n  ",
+    table[i]);
+  printf("\n};\n");
+
+  return 0;
+}
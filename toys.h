@@ -18,6 +18,7 @@
 #include <inttypes.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <pwd.h>
 #include <regex.h>
 #include <sched.h>
@@ -36,6 +37,7 @@
 #include <sys/statvfs.h>
 #include <sys/time.h>
 #include <sys/times.h>
+#include <sys/uio.h>
 #include <sys/utsname.h>
 #include <sys/wait.h>
 #include <syslog.h>
@@ -136,6 +138,18 @@ extern struct toy_context {
   int recursion;           // How many nested calls to toy_exec()
 } toys;
 
+// Resource use counters for TOYBOX_STATS, updated by the lib/ I/O and memory
+// wrappers. (Not in toy_context because toy_init() zeroes that.) Worker
+// threads call those wrappers too, so only change them through TOYSTAT().
+
+extern struct toy_stats {
+  long long rbytes, wbytes;
+  long reads, writes, opens, closes, seeks, allocs, reallocs;
+} toystats;
+
+#define TOYSTAT(field, n) \
+  __atomic_fetch_add(&toystats.field, n, __ATOMIC_RELAXED)
+
 // Two big temporary buffers: one for use by commands, one for library functions
 
 extern char toybuf[4096], libbuf[4096];
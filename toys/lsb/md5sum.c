@@ -1,15 +1,18 @@
-/* md5sum.c - Calculate RFC 1321 md5 hash and sha1 hash.
+/* md5sum.c - Calculate RFC 1321 md5 hash and sha1/sha256/sha512 hashes.
  *
  * Copyright 2012 Rob Landley <rob@landley.net>
  *
  * See http://refspecs.linuxfoundation.org/LSB_4.1.0/LSB-Core-generic/LSB-Core-generic/md5sum.html
  * and http://www.ietf.org/rfc/rfc1321.txt
+ * and http://csrc.nist.gov/publications/fips/fips180-4/fips-180-4.pdf
  *
  * They're combined this way to share infrastructure, and because md5sum is
  * and LSB standard command, sha1sum is just a good idea.
 
 USE_MD5SUM(NEWTOY(md5sum, "b", TOYFLAG_USR|TOYFLAG_BIN))
 USE_SHA1SUM(NEWTOY(sha1sum, "b", TOYFLAG_USR|TOYFLAG_BIN))
+USE_SHA256SUM(NEWTOY(sha256sum, "b", TOYFLAG_USR|TOYFLAG_BIN))
+USE_SHA512SUM(NEWTOY(sha512sum, "b", TOYFLAG_USR|TOYFLAG_BIN))
 
 config MD5SUM
   bool "md5sum"
@@ -33,6 +36,30 @@ config SHA1SUM
     Output one hash (20 hex digits) for each input file, followed by
     filename.
 
+    -b	brief (hash only, no filename)
+
+config SHA256SUM
+  bool "sha256sum"
+  default y
+  help
+    usage: sha256sum [FILE]...
+
+    calculate sha256 hash for each input file, reading from stdin if none.
+    Output one hash (32 hex digits) for each input file, followed by
+    filename.
+
+    -b	brief (hash only, no filename)
+
+config SHA512SUM
+  bool "sha512sum"
+  default y
+  help
+    usage: sha512sum [FILE]...
+
+    calculate sha512 hash for each input file, reading from stdin if none.
+    Output one hash (64 hex digits) for each input file, followed by
+    filename.
+
     -b	brief (hash only, no filename)
 */
 
@@ -40,16 +67,19 @@ config SHA1SUM
 #include "toys.h"
 
 GLOBALS(
-  unsigned state[5];
-  unsigned oldstate[5];
-  uint64_t count;
   union {
-    char c[64];
-    unsigned i[16];
-  } buffer;
+    unsigned i[8];
+    uint64_t i64[8];
+  } state;
+  uint64_t count;
+  char buffer[128];
+  void (*transform)(char *data);
+  int size;
 )
 
 #define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+#define ror(value, bits) (((value) >> (bits)) | ((value) << (32 - (bits))))
+#define ror64(value, bits) (((value) >> (bits)) | ((value) << (64 - (bits))))
 
 // for(i=0; i<64; i++) md5table[i] = abs(sin(i+1))*(1<<32);  But calculating
 // that involves not just floating point but pulling in -lm (and arguing with
@@ -78,54 +108,64 @@ static const uint8_t md5rot[64] = {
 
 // Mix next 64 bytes of data into md5 hash
 
-static void md5_transform(void)
+static void md5_transform(char *data)
 {
-  unsigned x[4], *b = TT.buffer.i;
-  int i;
-
-  memcpy(x, TT.state, sizeof(x));
-
+  unsigned a, b, c, d, f, w[16], swap;
+  int i, in;
+
+  memcpy(w, data, sizeof(w));
+  for (i=0; i<16; i++) w[i] = SWAP_LE32(w[i]);
+  a = TT.state.i[0];
+  b = TT.state.i[1];
+  c = TT.state.i[2];
+  d = TT.state.i[3];
+
+  // Four rounds of 16 operations, each round with its own mixing function
+  // and order of input words.
   for (i=0; i<64; i++) {
-    unsigned int in, temp, swap;
     if (i<16) {
       in = i;
-      temp = x[1];
-      temp = (temp & x[2]) | ((~temp) & x[3]);
+      f = (b&c) | (~b&d);
     } else if (i<32) {
-      in = (1+(5*i))&15;
-      temp = x[3];
-      temp = (x[1] & temp) | (x[2] & ~temp);
+      in = (1+5*i)&15;
+      f = (b&d) | (c&~d);
     } else if (i<48) {
       in = (3*i+5)&15;
-      temp = x[1] ^ x[2] ^ x[3];
+      f = b^c^d;
     } else {
       in = (7*i)&15;
-      temp = x[2] ^ (x[1] | ~x[3]);
+      f = c^(b|~d);
     }
-    temp += x[0] + b[in] + md5table[i];
-    swap = x[3];
-    x[3] = x[2];
-    x[2] = x[1];
-    x[1] += rol(temp, md5rot[i]);
-    x[0] = swap;
+    f += a + w[in] + md5table[i];
+    swap = d;
+    d = c;
+    c = b;
+    b += rol(f, md5rot[i]);
+    a = swap;
   }
-  for (i=0; i<4; i++) TT.state[i] += x[i];
+  TT.state.i[0] += a;
+  TT.state.i[1] += b;
+  TT.state.i[2] += c;
+  TT.state.i[3] += d;
 }
 
 // Mix next 64 bytes of data into sha1 hash.
 
 static const unsigned rconsts[]={0x5A827999,0x6ED9EBA1,0x8F1BBCDC,0xCA62C1D6};
 
-static void sha1_transform(void)
+static void sha1_transform(char *data)
 {
   int i, j, k, count;
-  unsigned *block = TT.buffer.i;
+  unsigned block[16], oldstate[5];
   unsigned *rot[5], *temp;
 
+  memcpy(block, data, sizeof(block));
+  for (i=0; i<16; i++) block[i] = SWAP_BE32(block[i]);
+
   // Copy context->state[] to working vars
   for (i=0; i<5; i++) {
-    TT.oldstate[i] = TT.state[i];
-    rot[i] = TT.state + i;
+    oldstate[i] = TT.state.i[i];
+    rot[i] = TT.state.i + i;
   }
   // 4 rounds of 20 operations each.
   for (i=count=0; i<4; i++) {
@@ -139,9 +179,7 @@ static void sha1_transform(void)
         else work ^= *rot[1];
       }
 
-      if (!i && j<16)
-        work += block[count] = (rol(block[count],24)&0xFF00FF00)
-                             | (rol(block[count],8)&0x00FF00FF);
+      if (!i && j<16) work += block[count];
       else
         work += block[count&15] = rol(block[(count+13)&15]
               ^ block[(count+8)&15] ^ block[(count+2)&15] ^ block[count&15], 1);
@@ -156,33 +194,127 @@ static void sha1_transform(void)
     }
   }
   // Add the previous values of state[]
-  for (i=0; i<5; i++) TT.state[i] += TT.oldstate[i];
+  for (i=0; i<5; i++) TT.state.i[i] += oldstate[i];
 }
 
-// Fill the 64-byte working buffer and call transform() when full.
+// sha256 and sha512 round constants are the fractional parts of the cube
+// roots of the first 80 primes, and initial state the square roots of the
+// first 8. Sha256 uses the top 32 bits of the first 64 of each.
+
+static const uint64_t sha512k[80] = {
+  0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+  0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+  0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+  0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+  0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+  0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+  0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+  0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+  0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+  0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+  0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+  0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+  0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+  0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+  0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+  0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+  0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+  0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+  0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+  0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+  0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+  0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+  0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+  0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+  0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+  0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+  0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+static const uint64_t sha512h[8] = {
+  0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL,
+  0xa54ff53a5f1d36f1ULL, 0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+  0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+// Mix next 64 bytes of data into sha256 hash.
 
-static void hash_update(char *data, unsigned int len, void (*transform)(void))
+static void sha256_transform(char *data)
+{
+  unsigned w[64], a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  memcpy(w, data, 64);
+  for (i=0; i<16; i++) w[i] = SWAP_BE32(w[i]);
+  for (; i<64; i++)
+    w[i] = w[i-16] + (ror(w[i-15], 7)^ror(w[i-15], 18)^(w[i-15]>>3))
+      + w[i-7] + (ror(w[i-2], 17)^ror(w[i-2], 19)^(w[i-2]>>10));
+
+  a = TT.state.i[0]; b = TT.state.i[1]; c = TT.state.i[2];
+  d = TT.state.i[3]; e = TT.state.i[4]; f = TT.state.i[5];
+  g = TT.state.i[6]; h = TT.state.i[7];
+  for (i=0; i<64; i++) {
+    t1 = h + (ror(e, 6)^ror(e, 11)^ror(e, 25)) + ((e&f)^(~e&g))
+      + (sha512k[i]>>32) + w[i];
+    t2 = (ror(a, 2)^ror(a, 13)^ror(a, 22)) + ((a&b)^(a&c)^(b&c));
+    h = g; g = f; f = e; e = d+t1;
+    d = c; c = b; b = a; a = t1+t2;
+  }
+  TT.state.i[0] += a; TT.state.i[1] += b; TT.state.i[2] += c;
+  TT.state.i[3] += d; TT.state.i[4] += e; TT.state.i[5] += f;
+  TT.state.i[6] += g; TT.state.i[7] += h;
+}
+
+// Mix next 128 bytes of data into sha512 hash.
+
+static void sha512_transform(char *data)
+{
+  uint64_t w[80], a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  memcpy(w, data, 128);
+  for (i=0; i<16; i++) w[i] = SWAP_BE64(w[i]);
+  for (; i<80; i++)
+    w[i] = w[i-16] + (ror64(w[i-15], 1)^ror64(w[i-15], 8)^(w[i-15]>>7))
+      + w[i-7] + (ror64(w[i-2], 19)^ror64(w[i-2], 61)^(w[i-2]>>6));
+
+  a = TT.state.i64[0]; b = TT.state.i64[1]; c = TT.state.i64[2];
+  d = TT.state.i64[3]; e = TT.state.i64[4]; f = TT.state.i64[5];
+  g = TT.state.i64[6]; h = TT.state.i64[7];
+  for (i=0; i<80; i++) {
+    t1 = h + (ror64(e, 14)^ror64(e, 18)^ror64(e, 41)) + ((e&f)^(~e&g))
+      + sha512k[i] + w[i];
+    t2 = (ror64(a, 28)^ror64(a, 34)^ror64(a, 39)) + ((a&b)^(a&c)^(b&c));
+    h = g; g = f; f = e; e = d+t1;
+    d = c; c = b; b = a; a = t1+t2;
+  }
+  TT.state.i64[0] += a; TT.state.i64[1] += b; TT.state.i64[2] += c;
+  TT.state.i64[3] += d; TT.state.i64[4] += e; TT.state.i64[5] += f;
+  TT.state.i64[6] += g; TT.state.i64[7] += h;
+}
+
+// Hash whole blocks straight out of data, using the working buffer only to
+// collect partial blocks.
+
+static void hash_update(char *data, unsigned int len)
 {
   unsigned int i, j;
 
-  j = TT.count & 63;
+  j = TT.count & (TT.size-1);
   TT.count += len;
 
-  for (;;) {
-    // Grab next chunk of data, return if it's not enough to process a frame
-    i = 64 - j;
+  // Finish off a partial block
+  if (j) {
+    i = TT.size - j;
     if (i>len) i = len;
-    memcpy(TT.buffer.c+j, data, i);
-    if (j+i != 64) break;
-
-    // Process a frame
-    if (IS_BIG_ENDIAN)
-      for (j=0; j<16; j++) TT.buffer.i[j] = SWAP_LE32(TT.buffer.i[j]);
-    transform();
-    j=0;
+    memcpy(TT.buffer+j, data, i);
+    if (j+i != TT.size) return;
+    TT.transform(TT.buffer);
     data += i;
     len -= i;
   }
+  for (; len >= TT.size; len -= TT.size, data += TT.size) TT.transform(data);
+  memcpy(TT.buffer, data, len);
 }
 
 // Callback for loopfiles()
@@ -190,46 +322,65 @@ static void hash_update(char *data, unsigned int len, void (*transform)(void))
 static void do_hash(int fd, char *name)
 {
   uint64_t count;
-  int i, sha1=toys.which->name[0]=='s';;
+  int i, type = toys.which->name[3];
   char buf;
-  void (*transform)(void);
-
-  /* SHA1 initialization constants  (md5sum uses first 4) */
-  TT.state[0] = 0x67452301;
-  TT.state[1] = 0xEFCDAB89;
-  TT.state[2] = 0x98BADCFE;
-  TT.state[3] = 0x10325476;
-  TT.state[4] = 0xC3D2E1F0;
+
+  // md5sum is "md5s", sha1sum "sha1", sha256sum "sha2", sha512sum "sha5"
+  TT.size = 64;
+  if (type == '2' || type == '5') {
+    if (type == '5') {
+      TT.size = 128;
+      TT.transform = sha512_transform;
+      for (i = 0; i<8; i++) TT.state.i64[i] = sha512h[i];
+    } else {
+      TT.transform = sha256_transform;
+      for (i = 0; i<8; i++) TT.state.i[i] = sha512h[i]>>32;
+    }
+  } else {
+    /* SHA1 initialization constants  (md5sum uses first 4) */
+    TT.state.i[0] = 0x67452301;
+    TT.state.i[1] = 0xEFCDAB89;
+    TT.state.i[2] = 0x98BADCFE;
+    TT.state.i[3] = 0x10325476;
+    TT.state.i[4] = 0xC3D2E1F0;
+    TT.transform = (type == '1') ? sha1_transform : md5_transform;
+  }
   TT.count = 0;
 
-  transform = sha1 ? sha1_transform : md5_transform;
   for (;;) {
     i = read(fd, toybuf, sizeof(toybuf));
     if (i<1) break;
-    hash_update(toybuf, i, transform);
+    hash_update(toybuf, i);
   }
 
-  count = TT.count << 3;
+  count = TT.count;
 
   // End the message by appending a "1" bit to the data, ending with the
-  // message size (in bits, big endian), and adding enough zero bits in
-  // between to pad to the end of the next 64-byte frame.
+  // message size (in bits, big endian except for md5), and adding enough
+  // zero bits in between to pad to the end of the next frame. The size
+  // field is 1/8 of the frame: 64 bits, or 128 for sha512.
   //
   // Since our input up to now has been in whole bytes, we can deal with
   // bytes here too.
 
   buf = 0x80;
   do {
-    hash_update(&buf, 1, transform);
+    hash_update(&buf, 1);
     buf = 0;
-  } while ((TT.count & 63) != 56);
-  count = sha1 ? SWAP_BE64(count) : SWAP_LE64(count);
-  hash_update((void *)&count, 8, transform);
+  } while ((TT.count & (TT.size-1)) != TT.size-TT.size/8);
+  if (type == '5') {
+    uint64_t high = SWAP_BE64(count>>61);
 
-  if (sha1)
-    for (i = 0; i < 20; i++)
-      printf("%02x", 255&(TT.state[i>>2] >> ((3-(i & 3)) * 8)));
-  else for (i=0; i<4; i++) printf("%08x", bswap_32(TT.state[i]));
+    hash_update((void *)&high, 8);
+  }
+  count = (type == 's') ? SWAP_LE64(count<<3) : SWAP_BE64(count<<3);
+  hash_update((void *)&count, 8);
+
+  if (type == 's')
+    for (i=0; i<4; i++) printf("%08x", bswap_32(TT.state.i[i]));
+  else if (type == '5')
+    for (i=0; i<8; i++) printf("%016llx", (unsigned long long)TT.state.i64[i]);
+  else for (i=0; i<(type == '1' ? 5 : 8); i++) printf("%08x", TT.state.i[i]);
 
   // Wipe variables. Cryptographer paranoia.
   memset(&TT, 0, sizeof(TT));
@@ -246,3 +397,13 @@ void sha1sum_main(void)
 {
   md5sum_main();
 }
+
+void sha256sum_main(void)
+{
+  md5sum_main();
+}
+
+void sha512sum_main(void)
+{
+  md5sum_main();
+}
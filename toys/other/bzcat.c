@@ -80,9 +80,6 @@ struct bunzip_data {
   int symTotal, groupCount, nSelectors;
   unsigned char symToByte[256], mtfSymbol[256];
 
-  // The CRC values stored in the block header and calculated from the data
-  unsigned int crc32Table[256];
-
   // Second pass decompression data (burrows-wheeler transform)
   unsigned int dbufSize;
   struct bwdata bwdata[THREADS];
@@ -496,7 +493,7 @@ int read_bunzip_data(struct bunzip_data *bd)
 int write_bunzip_data(struct bunzip_data *bd, struct bwdata *bw, int out_fd, char *outbuf, int len)
 {
   unsigned int *dbuf = bw->dbuf;
-  int count, pos, current, run, copies, outbyte, previous, gotcount = 0;
+  int count, pos, current, run, copies, outbyte, previous, gotcount = 0, crcpos;
 
   for (;;) {
     // If last read was short due to end of file, return last block now
@@ -518,11 +515,16 @@ int write_bunzip_data(struct bunzip_data *bd, struct bwdata *bw, int out_fd, cha
     pos = bw->writePos;
     current = bw->writeCurrent;
     run = bw->writeRun;
+    crcpos = bd->outbufPos;
     while (count) {
 
       // If somebody (like tar) wants a certain number of bytes of
       // data from memory instead of written to a file, humor them.
-      if (len && bd->outbufPos >= len) goto dataus_interruptus;
+      if (len && bd->outbufPos >= len) {
+        bw->dataCRC = crc32_be(bw->dataCRC, bd->outbuf+crcpos,
+          bd->outbufPos-crcpos);
+        goto dataus_interruptus;
+      }
       count--;
 
       // Follow sequence vector to undo Burrows-Wheeler transform.
@@ -542,18 +544,22 @@ int write_bunzip_data(struct bunzip_data *bd, struct bwdata *bw, int out_fd, cha
         outbyte = current;
       }
 
-      // Output bytes to buffer, flushing to file if necessary
+      // Output bytes to buffer, flushing to file (crc first) if necessary
       while (copies--) {
-        if (bd->outbufPos == IOBUF_SIZE) flush_bunzip_outbuf(bd, out_fd);
+        if (bd->outbufPos == IOBUF_SIZE) {
+          bw->dataCRC = crc32_be(bw->dataCRC, bd->outbuf+crcpos,
+            bd->outbufPos-crcpos);
+          flush_bunzip_outbuf(bd, out_fd);
+          crcpos = 0;
+        }
         bd->outbuf[bd->outbufPos++] = outbyte;
-        bw->dataCRC = (bw->dataCRC << 8)
-                ^ bd->crc32Table[(bw->dataCRC >> 24) ^ outbyte];
       }
       if (current != previous) run=0;
     }
 
     // decompression of this block completed successfully
-    bw->dataCRC = ~(bw->dataCRC);
+    bw->dataCRC = ~crc32_be(bw->dataCRC, bd->outbuf+crcpos,
+      bd->outbufPos-crcpos);
     bd->totalCRC = ((bd->totalCRC << 1) | (bd->totalCRC >> 31)) ^ bw->dataCRC;
 
     // if this block had a crc error, force file level crc error.
@@ -604,8 +610,6 @@ int start_bunzip(struct bunzip_data **bdp, int src_fd, char *inbuf, int len)
     bd->in_fd = src_fd;
   }
 
-  crc_init(bd->crc32Table, 0);
-
   // Ensure that file starts with "BZh".
   for (i=0;i<3;i++) if (get_bits(bd,8)!="BZh"[i]) return RETVAL_NOT_BZIP_DATA;
 
@@ -17,12 +17,13 @@ config REV
 
 static void do_rev(int fd, char *name)
 {
+  struct linebuf *lb = linebuf_new(fd);
   char *c;
 
   for (;;) {
     int len, i;
 
-    if (!(c = get_line(fd))) break;
+    if (!(c = linebuf_line(lb))) break;
     len = strlen(c) - 1;
     for (i = 0; i <= len/2; i++) {
       char tmp = c[i];
@@ -31,8 +32,8 @@ static void do_rev(int fd, char *name)
       c[len-i] = tmp;
     }
     xputs(c);
-    free(c);
   }
+  linebuf_free(lb);
 }
 
 void rev_main(void)
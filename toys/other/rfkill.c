@@ -74,6 +74,7 @@ void rfkill_main(void)
     // show list.
     while (sizeof(rfevent) == readall(fd, &rfevent, sizeof(rfevent))) {
       char *line, *name = 0, *type = 0;
+      struct linebuf *lb;
 
       // filter list items
       if ((tid > 0 && tid != rfevent.type) || (idx != -1 && idx != rfevent.idx))
@@ -81,14 +82,14 @@ void rfkill_main(void)
 
       sprintf(toybuf, "/sys/class/rfkill/rfkill%u/uevent", rfevent.idx);
       tvar = xopen(toybuf, O_RDONLY);
-      while ((line = get_line(tvar))) {
+      lb = linebuf_new(tvar);
+      while ((line = linebuf_line(lb))) {
         char *s = line;
 
         if (strstart(&s, "RFKILL_NAME=")) name = xstrdup(s);
         else if (strstart(&s, "RFKILL_TYPE=")) type = xstrdup(s);
-
-        free(line);
       }
+      linebuf_free(lb);
       xclose(tvar);
 
       xprintf("%u: %s: %s\n", rfevent.idx, name, type);
@@ -18,6 +18,7 @@ config TAC
 static void do_tac(int fd, char *name)
 {
   struct arg_list *list = NULL;
+  struct linebuf *lb = linebuf_new(fd);
   char *c;
 
   // Read in lines
@@ -25,13 +26,14 @@ static void do_tac(int fd, char *name)
     struct arg_list *temp;
     long len;
 
-    if (!(c = get_rawline(fd, &len, '\n'))) break;
+    if (!(c = linebuf_raw(lb, &len, '\n'))) break;
 
     temp = xmalloc(sizeof(struct arg_list));
     temp->next = list;
-    temp->arg = c;
+    temp->arg = xstrndup(c, len);
     list = temp;
   }
+  linebuf_free(lb);
 
   // Play them back.
   while (list) {
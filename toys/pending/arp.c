@@ -216,6 +216,7 @@ void arp_main(void)
   struct sockaddr sa;
   char ip[128], hw_addr[128], mask[12], dev[128], *host_ip = NULL, *buf;
   int h_type, type, flag, i, fd, entries = 0, disp = 0;
+  struct linebuf *lb;
 
   TT.device = "";
   memset(&sa, 0, sizeof(sa));
@@ -246,8 +247,8 @@ void arp_main(void)
 
   //show arp chache
   fd = xopen("/proc/net/arp", O_RDONLY);
-  buf = get_line(fd);
-  free(buf); //skip first line
+  lb = linebuf_new(fd);
+  linebuf_line(lb); //skip first line
 
   if (toys.optargs[0]) {
     resolve_host(toys.optargs[0], &sa);
@@ -255,7 +256,7 @@ void arp_main(void)
     host_ip = xstrdup(toybuf);
   }
 
-  while ((buf = get_line(fd))) {
+  while ((buf = linebuf_line(lb))) {
     char *host_name = "?";
     
     if ((sscanf(buf, "%s 0x%x 0x%x %s %s %s\n", ip,
@@ -263,10 +264,7 @@ void arp_main(void)
     entries++;
     if (((toys.optflags & FLAG_H) && (get_index(hwtype, TT.hw_type) != h_type))
      || ((toys.optflags & FLAG_i) && strcmp(TT.interface, dev))
-     || (toys.optargs[0] && strcmp(host_ip, ip))) {
-      free(buf);
-      continue;
-    }
+     || (toys.optargs[0] && strcmp(host_ip, ip))) continue;
 
     resolve_host(buf, &sa);
     if (!(toys.optflags & FLAG_n)) { 
@@ -291,8 +289,8 @@ void arp_main(void)
       if (flag_type[i].val & flag) printf(" %s", flag_type[i].name);
 
     printf(" on %s\n", dev);
-    free(buf);
   }
+  linebuf_free(lb);
   
   if (toys.optflags & FLAG_v) 
     xprintf("Entries: %d\tSkipped: %d\tFound: %d\n",
@@ -301,7 +299,6 @@ void arp_main(void)
   
   if (CFG_TOYBOX_FREE) {
     free(host_ip);
-    free(buf);
     xclose(fd);
   }
 }
@@ -174,10 +174,16 @@ static void start_logging()
   memset(TT.buf, 0, sizeof(TT.buf));
   while (--tcnt && !toys.signal) {
     int i = 0, j = 0, fd = open("/proc/uptime", O_RDONLY);
-    if (fd < 0) goto wait_usec;
-    char *line = get_line(fd);
+    struct linebuf *lb;
+    char *line;
 
-    if (!line)  goto wait_usec;
+    if (fd < 0) goto wait_usec;
+    lb = linebuf_new(fd);
+    if (!(line = linebuf_line(lb))) {
+      linebuf_free(lb);
+      close(fd);
+      goto wait_usec;
+    }
     while (line[i] != ' ') {
       if (line[i] == '.') {
         i++;
@@ -187,7 +193,7 @@ static void start_logging()
     }
     TT.buf[j++] = '\n';
     TT.buf[j] = '\0';
-    free(line);
+    linebuf_free(lb);
     close(fd);
     dump_data_in_file("/proc/stat", proc_stat_fd);
     dump_data_in_file("/proc/diskstats", proc_diskstats_fd);
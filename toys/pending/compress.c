@@ -16,7 +16,7 @@
 // Leave Lrg at end so flag values line up.
 
 USE_COMPRESS(NEWTOY(compress, "zcd9lrg[-cd][!zgLr]", TOYFLAG_USR|TOYFLAG_BIN))
-USE_GZIP(NEWTOY(gzip, USE_GZIP_D("d")"19dcflqStvgLRz[!gLRz]", TOYFLAG_USR|TOYFLAG_BIN))
+USE_GZIP(NEWTOY(gzip, USE_GZIP_D("d")"123456789cflqStvgLRz"USE_GZIP_PARALLEL("p#<1")"[!gLRz][-123456789]", TOYFLAG_USR|TOYFLAG_BIN))
 USE_ZCAT(NEWTOY(zcat, 0, TOYFLAG_USR|TOYFLAG_BIN))
 USE_GUNZIP(NEWTOY(gunzip, "cflqStv", TOYFLAG_USR|TOYFLAG_BIN))
 
@@ -50,8 +50,7 @@ config GZIP
     uncompressed version. The input file is removed and replaced with
     a new file without the .gz extension (with same ownership/permissions).
 
-    -1	Minimal compression (fastest)
-    -9	Max compression (default)
+    -1..9	Compression level, from fastest to smallest (default 6)
     -c	cat to stdout (act as zcat)
     -f	force (if output file exists, input is tty, unrecognized extension)
     -q	quiet (no warnings)
@@ -71,6 +70,15 @@ config GZIP_D
 
     -d	decompress (act as gunzip)
 
+config GZIP_PARALLEL
+  bool
+  default y
+  depends on GZIP && TOYBOX_THREADS
+  help
+    usage: gzip [-p N]
+
+    -p	compress with N threads
+
 config DECOMPRESS
   bool "decompress"
   default n
@@ -118,10 +126,12 @@ config GUNZIP
 #include "toys.h"
 
 GLOBALS(
+  long p;
+
   // Huffman codes: base offset and extra bits tables (length and distance)
   char lenbits[29], distbits[30];
   unsigned short lenbase[29], distbase[30];
-  void *fixdisthuff, *fixlithuff;
+  unsigned *fixdisthuff, *fixlithuff;
 
   // CRC
   void (*crcfunc)(char *data, int len);
@@ -130,10 +140,10 @@ GLOBALS(
   // Compressed data buffer
   char *data;
   unsigned pos, len;
-  int infd, outfd;
+  int outfd;
 
-  // Tables only used for deflation
-  unsigned short *hashhead, *hashchain;
+  // Only used for deflation
+  int level;
 )
 
 // little endian bit buffer
@@ -145,7 +155,8 @@ struct bitbuf {
 // malloc a struct bitbuf
 struct bitbuf *bitbuf_init(int fd, int size)
 {
-  struct bitbuf *bb = xzalloc(sizeof(struct bitbuf)+size);
+  // Room to peek 8 bytes past the end
+  struct bitbuf *bb = xzalloc(sizeof(struct bitbuf)+size+8);
 
   bb->max = size;
   bb->fd = fd;
@@ -166,17 +177,28 @@ void bitbuf_skip(struct bitbuf *bb, int bits)
   bb->bitpos = pos;
 }
 
-// Optimized single bit inlined version
-static inline int bitbuf_bit(struct bitbuf *bb)
+// Return the next 56+ bits without consuming them, reading more data when
+// fewer than 8 bytes are left in the buffer. Past the end of input is zeroes.
+static inline unsigned long long bitbuf_peek(struct bitbuf *bb)
 {
-  int bufpos = bb->bitpos>>3;
-
-  if (bufpos == bb->len) {
-    bitbuf_skip(bb, 0);
-    bufpos = 0;
+  unsigned long long bits;
+  int pos = bb->bitpos>>3, len;
+
+  if (bb->len-pos<8) {
+    if (pos>bb->len) error_exit("inflate EOF");
+    memmove(bb->buf, bb->buf+pos, bb->len -= pos);
+    bb->bitpos &= 7;
+    while (bb->len<8) {
+      if (!(len = read(bb->fd, bb->buf+bb->len, bb->max-bb->len))) break;
+      if (len<0) perror_exit("inflate");
+      bb->len += len;
+    }
+    memset(bb->buf+bb->len, 0, 8);
+    pos = 0;
   }
+  memcpy(&bits, bb->buf+pos, 8);
 
-  return (bb->buf[bufpos]>>(bb->bitpos++&7))&1;
+  return SWAP_LE64(bits)>>(bb->bitpos&7);
 }
 
 // Fetch the next X bits from the bitbuf, little endian
@@ -232,72 +254,117 @@ void bitbuf_put(struct bitbuf *bb, int data, int len)
   }
 }
 
-static void output_byte(char sym)
+// Turn bit lengths into canonical huffman codes, bit reversed because
+// bitbuf_put() is little endian but huffman codes go out high bit first.
+static void huff_codes(char *bits, unsigned short *codes, int len)
 {
-  int pos = TT.pos++ & 32767;
-
-  TT.data[pos] = sym;
-
-  if (!pos) {
-    xwrite(TT.outfd, TT.data, 32768);
-    if (TT.crcfunc) TT.crcfunc(TT.data, 32768);
+  unsigned short count[16], next[16];
+  int i, j, code = 0;
+
+  memset(count, 0, sizeof(count));
+  for (i = 0; i<len; i++) count[bits[i]]++;
+  for (*count = 0, i = 1; i<16; i++) next[i] = code = (code+count[i-1])<<1;
+  for (i = 0; i<len; i++) {
+    for (code = next[bits[i]]++, codes[i] = j = 0; j<bits[i]; j++)
+      codes[i] = (codes[i]<<1)|((code>>j)&1);
   }
 }
 
-// Huffman coding uses bits to traverse a binary tree to a leaf node,
-// By placing frequently occurring symbols at shorter paths, frequently
-// used symbols may be represented in fewer bits than uncommon symbols.
+// Huffman decode tables are indexed by the next "root" bits of input, giving
+// symbol | second literal<<12 | bits used<<20 | count<<25. Count 2 is a pair
+// of literals decoded at once. Count 0 means codes longer than root bits:
+// the low 12 bits are where the subtable starts and bits<<20 how many more
+// bits index it. An entry of 0 is an invalid code.
+static void huff_table(unsigned *table, int size, char *bitlen, int len,
+  int root, int pair)
+{
+  unsigned short codes[288];
+  char sub[1024];
+  int count[16], i, j, k, l, left, max = 0, next = 1<<root, mask = next-1;
+  unsigned e, f;
+
+  // Check for oversubscribed codes, incomplete is only ok for a single code
+  memset(count, 0, sizeof(count));
+  for (i = 0; i<len; i++) count[bitlen[i]]++;
+  for (left = 1, i = 1; i<16; i++) {
+    if (count[i]) max = i;
+    if ((left = (left<<1)-count[i])<0) error_exit("bad tree");
+  }
+  if (left && max>1) error_exit("bad tree");
+
+  huff_codes(bitlen, codes, len);
+  memset(table, 0, size*sizeof(*table));
+  memset(sub, 0, sizeof(sub));
+  for (i = 0; i<len; i++) {
+    if (!(l = bitlen[i])) continue;
+    if (l<=root) for (k = codes[i]; k<=mask; k += 1<<l)
+      table[k] = i|(l<<20)|(1<<25);
+    else if (l-root>sub[j = codes[i]&mask]) sub[j] = l-root;
+  }
 
-struct huff {
-  unsigned short length[16];
-  unsigned short symbol[288];
-};
+  // Lay out subtables after the root table, then fill them in
+  for (j = 0; j<=mask; j++) if (sub[j]) {
+    table[j] = next|(sub[j]<<20);
+    if ((next += 1<<sub[j])>size) error_exit("bad tree");
+  }
+  for (i = 0; i<len; i++) if ((l = bitlen[i])>root) {
+    e = table[codes[i]&mask];
+    for (k = codes[i]>>root; k<1<<((e>>20)&31); k += 1<<(l-root))
+      table[(e&4095)+k] = i|(l<<20)|(1<<25);
+  }
 
-// Create simple huffman tree from array of bit lengths.
+  // Pair up short literals: the bits after the first code index the root
+  // table again (with zeroes above them, so the second code must fit).
+  // Going backwards, the entry looked up hasn't been paired yet.
+  if (pair) for (j = mask; j>=0; j--) {
+    e = table[j];
+    l = (e>>20)&31;
+    if ((e>>25)!=1 || (e&4095)>255 || l>=root) continue;
+    f = table[j>>l];
+    if ((f>>25)!=1 || (f&4095)>255 || ((f>>20)&31)>root-l) continue;
+    table[j] = (e&4095)|((f&255)<<12)|((l+((f>>20)&31))<<20)|(2<<25);
+  }
+}
 
-// The symbols in the huffman trees are sorted (first by bit length
-// of the code to reach them, then by symbol number). This means that given
-// the bit length of each symbol, we can construct a unique tree.
-static void len2huff(struct huff *huff, char bitlen[], int len)
+// Look up the table entry for the next code in bits
+static inline unsigned huff_entry(unsigned *table, int root,
+  unsigned long long bits)
 {
-  int offset[16];
-  int i;
+  unsigned e = table[bits&((1<<root)-1)];
 
-  // Count number of codes at each bit length
-  memset(huff, 0, sizeof(struct huff));
-  for (i = 0; i<len; i++) huff->length[bitlen[i]]++;
-
-  // Sort symbols by bit length. (They'll remain sorted by symbol within that.)
-  *huff->length = *offset = 0;
-  for (i = 1; i<16; i++) offset[i] = offset[i-1] + huff->length[i-1];
+  if (!(e>>25)) {
+    if (e) e = table[(e&4095)+((bits>>root)&((1<<((e>>20)&31))-1))];
+    if (!(e>>25)) error_exit("bad symbol");
+  }
 
-  for (i = 0; i<len; i++) if (bitlen[i]) huff->symbol[offset[bitlen[i]]++] = i;
+  return e;
 }
 
-// Fetch and decode next huffman coded symbol from bitbuf.
-// This takes advantage of the sorting to navigate the tree as an array:
-// each time we fetch a bit we have all the codes at that bit level in
-// order with no gaps.
-static unsigned huff_and_puff(struct bitbuf *bb, struct huff *huff)
+// Write out inflated data from TT.data+start to TT.data+pos, then slide the
+// last 32k down to the start of the buffer as the window for future matches.
+// Returns the new position.
+static unsigned inflate_flush(unsigned start, unsigned pos)
 {
-  unsigned short *length = huff->length;
-  int start = 0, offset = 0;
+  xwrite(TT.outfd, TT.data+start, pos-start);
+  if (TT.crcfunc) TT.crcfunc(TT.data+start, pos-start);
+  if (pos<=32768) return pos;
+  memmove(TT.data, TT.data+pos-32768, 32768);
 
-  // Traverse through the bit lengths until our code is in this range
-  for (;;) {
-    offset = (offset << 1) | bitbuf_bit(bb);
-    start += *++length;
-    if ((offset -= *length) < 0) break;
-    if ((length - huff->length) & 16) error_exit("bad symbol");
-  }
-
-  return huff->symbol[start + offset];
+  return 32768;
 }
 
 // Decompress deflated data from bitbuf to TT.outfd.
+// Output collects in TT.data after the 32k window, and gets flushed when
+// there's 64k of it: matches then never wrap and can copy a word at a time.
 static void inflate(struct bitbuf *bb)
 {
+  unsigned *lithuff, *disthuff, *tables = xmalloc(3*2048*sizeof(unsigned)),
+    start = 0, pos = 0, e, sym, len, dist, used;
+  unsigned long long bits;
+  char *s, *t;
+
   TT.crc = ~0;
+  TT.len = 0;
   // repeat until spanked
   for (;;) {
     int final, type;
@@ -309,7 +376,7 @@ static void inflate(struct bitbuf *bb)
 
     // Uncompressed block?
     if (!type) {
-      int len, nlen;
+      int nlen;
 
       // Align to byte, read length
       bitbuf_skip(bb, (8-bb->bitpos)&7);
@@ -319,24 +386,23 @@ static void inflate(struct bitbuf *bb)
 
       // Dump literal output data
       while (len) {
-        int pos = bb->bitpos >> 3, bblen = bb->len - pos;
-        char *p = bb->buf+pos;
+        unsigned bbpos = bb->bitpos >> 3, bblen = bb->len - bbpos;
 
-        // dump bytes until done or end of current bitbuf contents
+        // copy bytes until done, end of current bitbuf contents, or full
+        if (pos>=98304) start = pos = inflate_flush(start, pos);
         if (bblen > len) bblen = len;
-        pos = bblen;
-        while (pos--) output_byte(*(p++));
+        if (bblen > 98304-pos) bblen = 98304-pos;
+        memcpy(TT.data+pos, bb->buf+bbpos, bblen);
+        pos += bblen;
         bitbuf_skip(bb, bblen << 3);
         len -= bblen;
       }
 
     // Compressed block
     } else {
-      struct huff *disthuff, *lithuff;
 
       // Dynamic huffman codes?
       if (type == 2) {
-        struct huff *h2 = ((struct huff *)toybuf)+1;
         int i, litlen, distlen, hufflen;
         char *hufflen_order = "\x10\x11\x12\0\x08\x07\x09\x06\x0a\x05\x0b"
                               "\x04\x0c\x03\x0d\x02\x0e\x01\x0f", *bits;
@@ -352,11 +418,13 @@ static void inflate(struct bitbuf *bb)
         // in a magic order, leaving the rest 0. Then make a tree out of it:
         memset(bits = toybuf+1, 0, 19);
         for (i=0; i<hufflen; i++) bits[hufflen_order[i]] = bitbuf_get(bb, 3);
-        len2huff(h2, bits, 19);
+        huff_table(tables, 128, bits, 19, 7, 0);
 
         // Use that tree to read in the literal and distance bit lengths
         for (i = 0; i < litlen + distlen;) {
-          int sym = huff_and_puff(bb, h2);
+          e = huff_entry(tables, 7, bitbuf_peek(bb));
+          bb->bitpos += (e>>20)&31;
+          sym = e&4095;
 
           // 0-15 are literals, 16 = repeat previous code 3-6 times,
           // 17 = 3-10 zeroes (3 bit), 18 = 11-138 zeroes (7 bit)
@@ -364,6 +432,7 @@ static void inflate(struct bitbuf *bb)
           else {
             int len = sym & 2;
 
+            if (sym == 16 && !i) error_exit("bad tree");
             len = bitbuf_get(bb, sym-14+len+(len>>1)) + 3 + (len<<2);
             memset(bits+i, bits[i-1] * !(sym&3), len);
             i += len;
@@ -371,8 +440,8 @@ static void inflate(struct bitbuf *bb)
         }
         if (i > litlen+distlen) error_exit("bad tree");
 
-        len2huff(lithuff = h2, bits, litlen);
-        len2huff(disthuff = ((struct huff *)toybuf)+2, bits+litlen, distlen);
+        huff_table(lithuff = tables, 2048, bits, litlen, 10, 1);
+        huff_table(disthuff = tables+2048, 2048, bits+litlen, distlen, 9, 0);
 
       // Static huffman codes
       } else {
@@ -380,24 +449,42 @@ static void inflate(struct bitbuf *bb)
         disthuff = TT.fixdisthuff;
       }
 
-      // Use huffman tables to decode block of compressed symbols
+      // Use huffman tables to decode block of compressed symbols. One 64 bit
+      // peek covers the longest match: 15+5 bits length, 15+13 bits distance.
       for (;;) {
-        int sym = huff_and_puff(bb, lithuff);
+        if (pos>=98304) start = pos = inflate_flush(start, pos);
+        e = huff_entry(lithuff, 10, bits = bitbuf_peek(bb));
+        bb->bitpos += len = (e>>20)&31;
 
-        // Literal?
-        if (sym < 256) output_byte(sym);
+        // Literal (or two)?
+        if (e>>26) {
+          TT.data[pos++] = e;
+          TT.data[pos++] = e>>12;
+        } else if ((sym = e&4095) < 256) TT.data[pos++] = sym;
 
         // Copy range?
         else if (sym > 256) {
-          int len, dist;
-
-          sym -= 257;
-          len = TT.lenbase[sym] + bitbuf_get(bb, TT.lenbits[sym]);
-          sym = huff_and_puff(bb, disthuff);
-          dist = TT.distbase[sym] + bitbuf_get(bb, TT.distbits[sym]);
-          sym = TT.pos & 32767;
-
-          while (len--) output_byte(TT.data[(TT.pos-dist) & 32767]);
+          if ((sym -= 257) > 28) error_exit("bad symbol");
+          bits >>= len;
+          used = TT.lenbits[sym];
+          len = TT.lenbase[sym] + (bits&((1<<used)-1));
+          e = huff_entry(disthuff, 9, bits >>= used);
+          if ((sym = e&4095) > 29) error_exit("bad symbol");
+          bits >>= (e>>20)&31;
+          dist = TT.distbase[sym] + (bits&((1<<TT.distbits[sym])-1));
+          bb->bitpos += used+((e>>20)&31)+TT.distbits[sym];
+          if (dist > pos) error_exit("bad dist");
+
+          s = TT.data+pos-dist;
+          t = TT.data+pos;
+          pos += len;
+          if (dist>=8) for (;; len -= 8) {
+            memcpy(t, s, 8);
+            if (len<=8) break;
+            s += 8;
+            t += 8;
+          } else if (dist==1) memset(t, *s, len);
+          else while (len--) *t++ = *s++;
 
         // End of block
         } else break;
@@ -408,48 +495,317 @@ static void inflate(struct bitbuf *bb)
     if (final) break;
   }
 
-  if (TT.pos & 32767) {
-    xwrite(TT.outfd, TT.data, TT.pos & 32767);
-    if (TT.crcfunc) TT.crcfunc(TT.data, TT.pos & 32767);
-  }
+  inflate_flush(start, pos);
+  free(tables);
 }
 
-// Deflate from TT.infd to bitbuf
-// For deflate, TT.len = input read, TT.pos = input consumed
-static void deflate(struct bitbuf *bb)
+// Calculate huffman code lengths from symbol frequencies, limited to max
+// bits. If the tree comes out too deep, flatten the frequencies and retry.
+static void huff_lengths(unsigned *freq, char *bits, int len, int max)
 {
-  char *data = TT.data;
-  int len, final = 0;
+  unsigned weight[576], f[288];
+  short up[576];
+  int i, j, n, a, b, deep;
 
-  TT.crc = ~0;
+  // An incomplete tree (one code) confuses some decoders, so use at least 2.
+  memcpy(f, freq, len*sizeof(*f));
+  for (i = n = 0; i<len; i++) n += !!f[i];
+  for (i = 0; n<2; i++) if (!f[i]) n += f[i] = 1;
+
+  for (;;) {
+    for (i = 0; i<len; i++) {
+      weight[i] = f[i];
+      up[i] = -1;
+    }
+
+    // Join the two lightest nodes without a parent until there's one left
+    for (n = len;; n++) {
+      for (a = b = -1, i = 0; i<n; i++) {
+        if (!weight[i] || up[i] != -1) continue;
+        if (a<0 || weight[i]<weight[a]) b = a, a = i;
+        else if (b<0 || weight[i]<weight[b]) b = i;
+      }
+      if (b<0) break;
+      weight[n] = weight[a]+weight[b];
+      up[n] = -1;
+      up[a] = up[b] = n;
+    }
 
-  while (!final) {
-    // Read next half-window of data if we haven't hit EOF yet.
-    len = readall(TT.infd, data+(TT.len&32768), 32768);
-    if (len < 0) perror_exit("read"); // todo: add filename
-    if (len != 32768) final++;
-    if (TT.crcfunc) TT.crcfunc(data+(TT.len&32768), len);
-    // TT.len += len;  crcfunc advances len
+    // A symbol's bit length is how many parents it has
+    for (i = deep = 0; i<len; i++) {
+      for (bits[i] = 0, j = i; weight[i] && up[j] != -1; j = up[j]) bits[i]++;
+      if (bits[i]>deep) deep = bits[i];
+    }
+    if (deep<=max) break;
+    for (i = 0; i<len; i++) if (f[i]) f[i] = (f[i]>>1)|1;
+  }
+}
 
-    // store block as literal
-    bitbuf_put(bb, final, 1);
-    bitbuf_put(bb, 0, 1);
+// Deflate state: one block's worth of lz77 output (sym is a literal byte, or
+// 256+length for a match with the corresponding dist), input in a 64k ring
+// buffer (plus room to mirror the first 258 bytes) and its hash chains.
+// Input comes from fd, or from in[] if fd is -1. The first dict bytes of
+// input are only for matches to refer back into, they aren't output.
+struct dblock {
+  unsigned short sym[32768], dist[32768], hashhead[32768], hashchain[32768];
+  unsigned start, count, pos, len, dict, inlen;
+  char lencode[259], distcode[512], data[65536+512], *in;
+  int fd;
+};
+
+static int distcode(struct dblock *db, unsigned dist)
+{
+  return db->distcode[dist<=256 ? dist-1 : 256+((dist-1)>>7)];
+}
+
+// Write a block of symbols out as whichever of stored, fixed huffman, or
+// dynamic huffman is smallest.
+static void deflate_block(struct bitbuf *bb, struct dblock *db, int final)
+{
+  char *order = "\x10\x11\x12\0\x08\x07\x09\x06\x0a\x05\x0b\x04\x0c\x03\x0d"
+    "\x02\x0e\x01\x0f", bits[286+30], clbits[19], fixbits[288+30], *lbits,
+    *dbits;
+  unsigned freq[286+30], clfreq[19], *dfreq = freq+286, i, c, sym, end, extra,
+    fix, dyn, stored;
+  unsigned short rle[286+30], codes[286+30], clcodes[19], fixcodes[288+30],
+    *lcodes, *dcodes;
+  int hlit, hdist, hclen, nrle, run;
+
+  // Count symbols, and the extra bits both huffman encodings need
+  memset(freq, 0, sizeof(freq));
+  freq[256] = 1;
+  for (i = extra = 0, end = db->start; i<db->count; i++) {
+    if ((sym = db->sym[i])<256) {
+      freq[sym]++;
+      end++;
+    } else {
+      freq[257+(c = db->lencode[sym -= 256])]++;
+      extra += TT.lenbits[c];
+      end += sym;
+      dfreq[c = distcode(db, db->dist[i])]++;
+      extra += TT.distbits[c];
+    }
+  }
 
+  // Build dynamic tables, trim unused codes off the end
+  huff_lengths(freq, bits, 286, 15);
+  huff_lengths(dfreq, bits+286, 30, 15);
+  for (hlit = 286; hlit>257 && !bits[hlit-1]; hlit--);
+  for (hdist = 30; hdist>1 && !bits[286+hdist-1]; hdist--);
+  memmove(bits+hlit, bits+286, hdist);
+
+  // Run length encode the combined bit lengths: 16 repeats previous length
+  // 3-6 times, 17 is 3-10 zeroes, 18 is 11-138 zeroes. Extra bits go in the
+  // top of each rle entry.
+  for (i = nrle = 0; i<hlit+hdist;) {
+    c = bits[i];
+    for (run = 1; i+run<hlit+hdist && bits[i+run]==c; run++);
+    if (!c && run>2) {
+      if (run>138) run = 138;
+      rle[nrle++] = run<11 ? 17+((run-3)<<5) : 18+((run-11)<<5);
+      i += run;
+    } else {
+      rle[nrle++] = c;
+      for (i++, run--; run>2; run -= c) {
+        c = run>6 ? 6 : run;
+        rle[nrle++] = 16+((c-3)<<5);
+        i += c;
+      }
+    }
+  }
+  memset(clfreq, 0, sizeof(clfreq));
+  for (i = 0; i<nrle; i++) clfreq[rle[i]&31]++;
+  huff_lengths(clfreq, clbits, 19, 7);
+  for (hclen = 19; hclen>4 && !clbits[order[hclen-1]]; hclen--);
+
+  // Compare sizes
+  dyn = 3+14+3*hclen;
+  for (i = 0; i<19; i++) dyn += clfreq[i]*(clbits[i]+(i>15 ? "\2\3\7"[i-16] : 0));
+  for (i = 0; i<hlit; i++) dyn += freq[i]*bits[i];
+  for (i = 0; i<hdist; i++) dyn += dfreq[i]*bits[hlit+i];
+  for (i = 0; i<288; i++)
+    fixbits[i] = 8+(i>143)-((i>255)<<1)+(i>279);
+  memset(fixbits+288, 5, 30);
+  for (i = 0, fix = 3; i<286; i++) fix += freq[i]*fixbits[i];
+  for (i = 0; i<30; i++) fix += dfreq[i]*5;
+  dyn += extra;
+  fix += extra;
+  stored = 3+((8-((bb->bitpos+3)&7))&7)+32+8*(end-db->start);
+
+  if (stored<=fix && stored<=dyn) {
+    bitbuf_put(bb, final, 3);
     bitbuf_put(bb, 0, (8-bb->bitpos)&7);
-    bitbuf_put(bb, len, 16);
-    bitbuf_put(bb, 0xffff & ~len, 16);
+    bitbuf_put(bb, end-db->start, 16);
+    bitbuf_put(bb, 0xffff&~(end-db->start), 16);
+    for (i = db->start; i != end; i++) bitbuf_put(bb, db->data[i&65535], 8);
+  } else {
+    if (fix<=dyn) {
+      bitbuf_put(bb, final+2, 3);
+      huff_codes(lbits = fixbits, lcodes = fixcodes, 288);
+      huff_codes(dbits = fixbits+288, dcodes = fixcodes+288, 30);
+    } else {
+      bitbuf_put(bb, final+4, 3);
+      bitbuf_put(bb, hlit-257, 5);
+      bitbuf_put(bb, hdist-1, 5);
+      bitbuf_put(bb, hclen-4, 4);
+      for (i = 0; i<hclen; i++) bitbuf_put(bb, clbits[order[i]], 3);
+      huff_codes(clbits, clcodes, 19);
+      for (i = 0; i<nrle; i++) {
+        c = rle[i]&31;
+        bitbuf_put(bb, clcodes[c], clbits[c]);
+        if (c>15) bitbuf_put(bb, rle[i]>>5, "\2\3\7"[c-16]);
+      }
+      huff_codes(lbits = bits, lcodes = codes, hlit);
+      huff_codes(dbits = bits+hlit, dcodes = codes+hlit, hdist);
+    }
 
-    // repeat until spanked
-    while (TT.pos != TT.len) {
-      unsigned pos = TT.pos & 65535;
+    for (i = 0; i<db->count; i++) {
+      if ((sym = db->sym[i])<256) bitbuf_put(bb, lcodes[sym], lbits[sym]);
+      else {
+        c = db->lencode[sym -= 256];
+        bitbuf_put(bb, lcodes[257+c], lbits[257+c]);
+        bitbuf_put(bb, sym-TT.lenbase[c], TT.lenbits[c]);
+        c = distcode(db, sym = db->dist[i]);
+        bitbuf_put(bb, dcodes[c], dbits[c]);
+        bitbuf_put(bb, sym-TT.distbase[c], TT.distbits[c]);
+      }
+    }
+    bitbuf_put(bb, lcodes[256], lbits[256]);
+  }
+  db->start = end;
+  db->count = 0;
+}
 
-      bitbuf_put(bb, data[pos], 8);
+// Queue up a literal (dist 0) or match, writing out the block when full
+static void deflate_sym(struct bitbuf *bb, struct dblock *db, unsigned sym,
+  unsigned dist)
+{
+  db->sym[db->count] = sym;
+  db->dist[db->count++] = dist;
+  if (db->count == 32768) deflate_block(bb, db, 0);
+}
 
-      // need to refill buffer?
-      if (!(32767 & ++TT.pos) && !final) break;
+// Add position to hash chains (needs 3 bytes of data there)
+static unsigned deflate_hash(struct dblock *db, unsigned pos)
+{
+  unsigned char *s = (void *)(db->data+(pos&65535));
+  unsigned h = ((s[0]<<10)^(s[1]<<5)^s[2])&32767;
+
+  db->hashchain[pos&32767] = db->hashhead[h];
+  db->hashhead[h] = pos;
+
+  return db->hashchain[pos&32767];
+}
+
+// Deflate db's input to bitbuf, ending with a final block if finish, else
+// a sync flush (empty stored block) so more deflate data can be appended.
+// db->len = input read, db->pos = input consumed
+// Data goes into a 64k ring buffer a 32k half at a time, positions in the
+// hash chains are stored mod 65536 and checked against the actual data.
+static void deflate(struct bitbuf *bb, struct dblock *db, int finish)
+{
+  // Per level: how many hash chain entries to check, match length that's
+  // good enough to stop looking, and (lazy levels) keep looking for a better
+  // match at the next byte when the current one's shorter than this.
+  unsigned short chains[] = {4, 8, 32, 16, 32, 128, 256, 1024, 4096},
+    nices[] = {8, 16, 32, 16, 32, 128, 128, 258, 258},
+    lazies[] = {0, 0, 0, 4, 16, 16, 32, 128, 258};
+  char *data = db->data, *s, *t;
+  unsigned p, cand, dist, last, best, bdist, limit, plen = 0, pdist = 0, i,
+    chain, nice = nices[TT.level-1], lazy = lazies[TT.level-1];
+  int len, final = 0, have = 0;
+
+  db->start = db->dict;
+  for (i = 0; i<29; i++) for (len = TT.lenbase[i];
+    len<(i<28 ? TT.lenbase[i+1] : 259); len++) db->lencode[len] = i;
+  for (i = 0; i<30; i++) for (p = TT.distbase[i];
+    p<TT.distbase[i]+(1<<TT.distbits[i]); p++)
+      db->distcode[p<=256 ? p-1 : 256+((p-1)>>7)] = i;
+
+  for (;;) {
+    // Keep at least a max length match (plus hash) worth of lookahead.
+    // Write out the block first so stored blocks can still see their data.
+    if (!final && db->len-db->pos<262) {
+      if (db->count) deflate_block(bb, db, 0);
+      s = data+(db->len&65535);
+      if (db->fd == -1) {
+        if ((len = db->inlen-db->len)>32768) len = 32768;
+        memcpy(s, db->in+db->len, len);
+      } else if ((len = readall(db->fd, s, 32768)) < 0)
+        perror_exit("read"); // todo: add filename
+      else if (TT.crcfunc) TT.crcfunc(s, len);
+      if (len != 32768) final++;
+      // Mirror start of ring past the end so matches needn't wrap
+      if (!(db->len&65535)) memcpy(data+65536, data, 258);
+      db->len += len;
+
+      continue;
+    }
+    if ((p = db->pos) == db->len) break;
+
+    // Dictionary just goes in the hash chains
+    if (p<db->dict) {
+      if (p+2<db->len) deflate_hash(db, p);
+      db->pos++;
+
+      continue;
+    }
+
+    // Find longest match, walking back through the hash chain until the
+    // distance stops increasing (stale entry) or gets too far
+    best = bdist = 0;
+    if ((limit = db->len-p)>258) limit = 258;
+    if (limit>2) {
+      cand = deflate_hash(db, p);
+      if (!have || plen<lazy) {
+        s = data+(p&65535);
+        for (last = 0, chain = chains[TT.level-1]; chain--; last = dist) {
+          dist = (p-cand)&65535;
+          if (dist<=last || dist>32768-262 || dist>p) break;
+          t = data+(cand&65535);
+          if (t[best] == s[best] || !best) {
+            for (i = 0; i<limit && s[i]==t[i]; i++);
+            if (i>best) {
+              best = i;
+              bdist = dist;
+              if (i>=nice) break;
+            }
+          }
+          cand = db->hashchain[cand&32767];
+        }
+        // A far away 3 byte match usually costs more than the literals.
+        if (best<3 || (best==3 && bdist>4096)) best = 0;
+      }
     }
+
+    // Greedy: take the match. Lazy: take the previous match unless this
+    // one's longer.
+    if (!lazy && best) {
+      deflate_sym(bb, db, 256+best, bdist);
+      while (--best) if (++p+2<db->len) deflate_hash(db, p);
+      db->pos = p+1;
+    } else if (have && plen && plen>=best) {
+      deflate_sym(bb, db, 256+plen, pdist);
+      for (plen -= 2; plen--;) if (++p+2<db->len) deflate_hash(db, p);
+      db->pos = p+1;
+      have = 0;
+    } else if (lazy) {
+      if (have) deflate_sym(bb, db, (unsigned char)data[(p-1)&65535], 0);
+      have = 1;
+      plen = best;
+      pdist = bdist;
+      db->pos++;
+    } else deflate_sym(bb, db, (unsigned char)data[db->pos++&65535], 0);
+  }
+  if (have) deflate_sym(bb, db, (unsigned char)data[(db->pos-1)&65535], 0);
+  if (finish) deflate_block(bb, db, 1);
+  else {
+    if (db->count) deflate_block(bb, db, 0);
+    bitbuf_put(bb, 0, 3);
+    bitbuf_put(bb, 0, (8-bb->bitpos)&7);
+    bitbuf_put(bb, 0, 16);
+    bitbuf_put(bb, 0xffff, 16);
   }
-  bitbuf_flush(bb);
 }
 
 // Allocate memory for deflate/inflate.
@@ -457,13 +813,6 @@ static void init_deflate(int compress)
 {
   int i, n = 1;
 
-  // compress needs 64k data and 32k each for hashhead and hashchain.
-  // decompress just needs 32k data.
-  TT.data = xmalloc(32768*(compress ? 4 : 1));
-  if (compress) {
-    TT.hashhead = (unsigned short *)(TT.data + 65536);
-    TT.hashchain = (unsigned short *)(TT.data + 65536 + 32768);
-  }
 
   // Calculate lenbits, lenbase, distbits, distbase
   *TT.lenbase = 3;
@@ -486,11 +835,17 @@ static void init_deflate(int compress)
     TT.distbits[i] = n;
   }
 
-  // Init fixed huffman tables
+  // compress keeps its buffers in struct dblock. Decompress needs a 32k
+  // window plus 64k of output (and room for a match past that), and the
+  // fixed huffman tables.
+  if (compress) return;
+  TT.data = xmalloc(32768+65536+512);
+  TT.fixlithuff = xmalloc((1024+512)*sizeof(unsigned));
+  TT.fixdisthuff = TT.fixlithuff+1024;
   for (i=0; i<288; i++) toybuf[i] = 8 + (i>143) - ((i>255)<<1) + (i>279);
-  len2huff(TT.fixlithuff = ((struct huff *)toybuf)+3, toybuf, 288);
-  memset(toybuf, 5, 30);
-  len2huff(TT.fixdisthuff = ((struct huff *)toybuf)+4, toybuf, 30);
+  huff_table(TT.fixlithuff, 1024, toybuf, 288, 10, 1);
+  memset(toybuf, 5, 32);
+  huff_table(TT.fixdisthuff, 512, toybuf, 32, 9, 0);
 }
 
 // Return true/false whether we consumed a gzip header.
@@ -514,15 +869,119 @@ static int is_gzip(struct bitbuf *bb)
 
 void gzip_crc(char *data, int len)
 {
-  int i;
-  unsigned crc, *crc_table = (unsigned *)(toybuf+sizeof(toybuf)-1024);
-
-  crc = TT.crc;
-  for (i=0; i<len; i++) crc = crc_table[(crc^data[i])&0xff] ^ (crc>>8);
-  TT.crc = crc;
+  TT.crc = crc32_le(TT.crc, data, len);
   TT.len += len;
 }
 
+// Multiply vector by 32x32 bit matrix over GF(2)
+static unsigned gf2_times(unsigned *mat, unsigned vec)
+{
+  unsigned sum = 0;
+
+  for (; vec; vec >>= 1, mat++) if (vec&1) sum ^= *mat;
+
+  return sum;
+}
+
+// Given the crc of A, and the crc and length of B, return the crc of A+B.
+// The crc of A needs len2 zero bytes run through it, which is a matrix
+// multiply: square the one zero bit matrix up to 1, 2, 4, 8... bytes and
+// apply the ones matching bits of len2.
+static unsigned gzip_crc_combine(unsigned crc1, unsigned crc2, unsigned len2)
+{
+  unsigned op[32], sq[32], i, j;
+
+  op[0] = 0xedb88320;
+  for (i = 1; i<32; i++) op[i] = 1<<(i-1);
+  for (j = 0; len2; j++) {
+    for (i = 0; i<32; i++) sq[i] = gf2_times(op, op[i]);
+    memcpy(op, sq, sizeof(op));
+    if (j>1) {
+      if (len2&1) crc1 = gf2_times(op, crc1);
+      len2 >>= 1;
+    }
+  }
+
+  return crc1^crc2;
+}
+
+// gzip -p: threads compress 128k chunks of input, each primed with the 32k
+// before it and ending with a sync flush, so the output concatenates into
+// one deflate stream.
+struct gzip_job {
+  struct dblock db;
+  struct bitbuf *bb;
+  unsigned crc;
+  int last;
+};
+
+static void *gzip_job(void *arg)
+{
+  struct gzip_job *job = arg;
+  struct dblock *db = &job->db;
+
+  job->crc = ~crc32_le(~0, db->in+db->dict, db->inlen-db->dict);
+  db->pos = db->len = db->count = job->bb->bitpos = 0;
+  memset(db->hashhead, 0, sizeof(db->hashhead));
+  memset(job->bb->buf, 0, job->bb->max);
+  deflate(job->bb, db, job->last);
+
+  return 0;
+}
+
+static void gzip_parallel(int fd)
+{
+  struct gzip_job *jobs = xzalloc(TT.p*sizeof(*jobs)), *job, *prev = 0;
+  pthread_t *tids = xmalloc(TT.p*sizeof(pthread_t));
+  unsigned crc = 0, dict;
+  int i, j, n, len, last = 0;
+
+  // Fill in the crc tables before threads use them
+  crc32_le(0, 0, 0);
+  for (i = 0; i<TT.p; i++) {
+    jobs[i].db.in = xmalloc(32768+131072);
+    jobs[i].db.fd = -1;
+    // Blocks are never bigger than stored, so this won't flush
+    jobs[i].bb = bitbuf_init(-1, 131072+4096);
+  }
+
+  while (!last) {
+    // Read a chunk per thread, copying the end of the previous one in front.
+    for (n = 0; n<TT.p && !last; n++, prev = job) {
+      job = jobs+n;
+      dict = prev ? prev->db.inlen<32768 ? prev->db.inlen : 32768 : 0;
+      if (prev) memmove(job->db.in, prev->db.in+prev->db.inlen-dict, dict);
+      if ((len = readall(fd, job->db.in+dict, 131072)) < 0)
+        perror_exit("read"); // todo: add filename
+      job->db.dict = dict;
+      job->db.inlen = dict+len;
+      job->last = last = len != 131072;
+    }
+
+    // Run jobs in threads, the last one (and any we can't start) in this one.
+    for (i = 0; i<n-1; i++)
+      if (pthread_create(tids+i, 0, gzip_job, jobs+i)) break;
+    for (j = i; j<n; j++) gzip_job(jobs+j);
+    while (i--) pthread_join(tids[i], 0);
+
+    for (i = 0; i<n; i++) {
+      job = jobs+i;
+      len = job->db.inlen-job->db.dict;
+      crc = gzip_crc_combine(crc, job->crc, len);
+      TT.len += len;
+      xwrite(1, job->bb->buf, (job->bb->bitpos+7)/8);
+    }
+  }
+  TT.crc = ~crc;
+
+  for (i = 0; i<TT.p; i++) {
+    free(jobs[i].db.in);
+    free(jobs[i].bb);
+  }
+  free(tids);
+  free(jobs);
+}
+
 static void do_gzip(int fd, char *name)
 {
   struct bitbuf *bb = bitbuf_init(1, sizeof(toybuf));
@@ -532,14 +991,20 @@ static void do_gzip(int fd, char *name)
   // 4 byte MTIME (zeroed), Extra Flags (2=maximum compression),
   // Operating System (FF=unknown)
  
-  TT.infd = fd;
   xwrite(bb->fd, "\x1f\x8b\x08\0\0\0\0\0\x02\xff", 10);
 
-  // Use last 1k of toybuf for little endian crc table
-  crc_init((unsigned *)(toybuf+sizeof(toybuf)-1024), 1);
   TT.crcfunc = gzip_crc;
+  TT.crc = ~0;
+  TT.len = 0;
 
-  deflate(bb);
+  if (CFG_GZIP_PARALLEL && TT.p>1) gzip_parallel(fd);
+  else {
+    struct dblock *db = xzalloc(sizeof(struct dblock));
+
+    db->fd = fd;
+    deflate(bb, db, 1);
+    free(db);
+  }
 
   // tail: crc32, len32
 
@@ -558,8 +1023,6 @@ static void do_zcat(int fd, char *name)
   if (!is_gzip(bb)) error_exit("not gzip");
   TT.outfd = 1;
 
-  // Use last 1k of toybuf for little endian crc table
-  crc_init((unsigned *)(toybuf+sizeof(toybuf)-1024), 1);
   TT.crcfunc = gzip_crc;
 
   inflate(bb);
@@ -598,8 +1061,17 @@ void gunzip_main(void)
   loopfiles(toys.optargs, do_zcat);
 }
 
+#define CLEANUP_compress
+#define FOR_gzip
+#include "generated/flags.h"
+
 void gzip_main(void)
 {
+  int i;
+
+  // Default to the same level as everybody else.
+  for (TT.level = 6, i = 1; i<10; i++)
+    if (toys.optflags & (FLAG_9<<(9-i))) TT.level = i;
   init_deflate(1);
 
   loopfiles(toys.optargs, do_gzip);
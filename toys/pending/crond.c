@@ -372,6 +372,7 @@ static void scan_cronfiles()
   while ((entry = readdir(dp))) {
     int fd;
     char *line;
+    struct linebuf *lb;
     CRONFILE *cfile;
 
     if (entry->d_name[0] == '.' && (!entry->d_name[1] ||
@@ -388,8 +389,9 @@ static void scan_cronfiles()
     cfile = xzalloc(sizeof(CRONFILE));
     cfile->username = xstrdup(entry->d_name);
 
-    for (; (line = get_line(fd)); free(line))
-      parse_line(line, cfile);
+    lb = linebuf_new(fd);
+    while ((line = linebuf_line(lb))) parse_line(line, cfile);
+    linebuf_free(lb);
 
     // If there is no job for a cron, remove the VAR list.
     if (!cfile->job) {
@@ -114,9 +114,10 @@ static int parse_crontab(char *fname)
 {
   char *line;
   int lno, fd = xopen(fname, O_RDONLY);
+  struct linebuf *lb = linebuf_new(fd);
   long plen = 0;
 
-  for (lno = 1; (line = get_rawline(fd, &plen, '\n')); lno++,free(line)) {
+  for (lno = 1; (line = linebuf_raw(lb, &plen, '\n')); lno++) {
     char *name, *val, *tokens[5] = {0,}, *ptr = line;
     int count = 0;
 
@@ -199,10 +200,11 @@ static int parse_crontab(char *fname)
         break;
     }
   }
+  linebuf_free(lb);
   xclose(fd);
   return 0;
 OUT:
-  free(line);
+  linebuf_free(lb);
   printf("Error at line no %s", toybuf);
   xclose(fd);
   return 1;
@@ -83,19 +83,19 @@ static int cmp(struct value *lhs, struct value *rhs)
 
 static void re(struct value *lhs, struct value *rhs)
 {
-  regex_t rp;
+  struct regdfa rp;
   regmatch_t rm[2];
 
-  xregcomp(&rp, rhs->s, 0);
-  if (!regexec(&rp, lhs->s, 2, rm, 0) && rm[0].rm_so == 0) {
-    if (rp.re_nsub > 0 && rm[1].rm_so >= 0) 
+  xregdfa(&rp, rhs->s, 0);
+  if (!regdfa_exec(&rp, lhs->s, 2, rm, 0) && rm[0].rm_so == 0) {
+    if (rp.re.re_nsub > 0 && rm[1].rm_so >= 0) 
       lhs->s = xmprintf("%.*s", rm[1].rm_eo - rm[1].rm_so, lhs->s+rm[1].rm_so);
     else {
       lhs->i = rm[0].rm_eo;
       lhs->s = 0;
     }
   } else {
-    if (!rp.re_nsub) {
+    if (!rp.re.re_nsub) {
       lhs->i = 0;
       lhs->s = 0;
     } else lhs->s = "";
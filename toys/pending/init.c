@@ -123,8 +123,9 @@ static void add_new_action(uint8_t action,char *command,char *term)
 static void inittab_parsing(void)
 {
   int i, fd, line_number = 0, token_count = 0;
-  char *p, *q, *extracted_token, *tty_name = NULL, *command = NULL, *tmp;
+  char *p, *extracted_token, *tty_name = NULL, *command = NULL, *tmp;
   uint8_t action = 0;
+  struct linebuf *lb;
   char *act_name = "sysinit\0wait\0once\0respawn\0askfirst\0ctrlaltdel\0"
                     "shutdown\0restart\0";
 
@@ -134,7 +135,8 @@ static void inittab_parsing(void)
     add_new_action(SYSINIT, "/etc/init.d/rcS", "");
     add_new_action(RESPAWN, "/sbin/getty -n -l /bin/sh -L 115200 tty1 vt100", "");
   } else {
-    while((q = p = get_line(fd))) { //read single line from /etc/inittab
+    lb = linebuf_new(fd);
+    while((p = linebuf_line(lb))) { //read single line from /etc/inittab
       char *x;
 
       if ((x = strchr(p, '#'))) *x = '\0';
@@ -173,7 +175,6 @@ static void inittab_parsing(void)
         }
       }  //while token
 
-      if (q) free(q);
       if (token_count != 4) {
         free(tty_name);
         free(command);
@@ -184,6 +185,7 @@ static void inittab_parsing(void)
       free(command);
     } //while line
 
+    linebuf_free(lb);
     close(fd);
   }
 }
@@ -169,9 +169,10 @@ static void parseRPDB(char *fname, struct arglist **list, int32_t size)
 {
   char *line;
   int fd = open(fname, O_RDONLY);
+  struct linebuf *lb;
 
   if (fd < 0) return;
-  for (; (line = get_line(fd)); free(line)) {
+  for (lb = linebuf_new(fd); (line = linebuf_line(lb));) {
     char *ptr = line;
     int32_t idx;
 
@@ -182,8 +183,8 @@ static void parseRPDB(char *fname, struct arglist **list, int32_t size)
         (sscanf(ptr, "%d %s\n", &idx, toybuf) != 2) &&
         (sscanf(ptr, "%d %s #", &idx, toybuf) != 2)) {
       error_msg("Corrupted '%s' file", fname);
+      linebuf_free(lb);
       xclose(fd);
-      free(line);
       return;
     }
     if (idx >= 0 && idx < size) {
@@ -194,6 +195,7 @@ static void parseRPDB(char *fname, struct arglist **list, int32_t size)
       list[index]->name = xstrdup(toybuf);
     }
   }
+  linebuf_free(lb);
   xclose(fd);
 }
 
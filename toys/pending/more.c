@@ -62,10 +62,12 @@ static int prompt(FILE *cin, const char* fmt, ...)
 
 static void do_cat_operation(int fd, char *name)
 {
-  char *buf = NULL;
-  
+  struct linebuf *lb = linebuf_new(fd);
+  char *buf;
+
   if (toys.optc > 1) show_file_header(name);
-  for (; (buf = get_line(fd)); free(buf)) printf("%s\n", buf);
+  while ((buf = linebuf_line(lb))) printf("%s\n", buf);
+  linebuf_free(lb);
 }
 
 void more_main()
@@ -49,11 +49,11 @@ static int exec_action(unsigned pid, char *name, int signal)
   return 0;
 }
 
-static int regex_match(regex_t *rp, char *tar, char *patt)
+static int regex_match(struct regdfa *rp, char *tar, char *patt)
 {
   regmatch_t rm[1];
   int len = strlen(tar);
-  if (regexec(rp, tar, 1, rm, 0) == 0) {
+  if (regdfa_exec(rp, tar, 1, rm, 0) == 0) {
     if (flag_chk(FLAG_x)) {
       if ((rm[0].rm_so == 0) && ((rm[0].rm_eo - rm[0].rm_so) == len)) return 1;
     } else return 1;
@@ -66,7 +66,7 @@ void pgrep_main(void)
   int signum=0, eval=0, ret=1;
   DIR *dp=NULL;
   struct dirent *entry=NULL;
-  regex_t rp;
+  struct regdfa rp;
   unsigned  pid=0, ppid=0, sid=0, latest_pid=0;
   char *cmdline=NULL, *latest_cmdline = NULL;
   pid_t self = getpid();
@@ -100,9 +100,10 @@ void pgrep_main(void)
     error_exit("max argument > 1");
   }
   if (*toys.optargs) { /* compile regular expression(PATTERN) */
-    if ((eval = regcomp(&rp, *toys.optargs, REG_EXTENDED | REG_NOSUB)) != 0) {
+    if ((eval = regdfa_comp(&rp, *toys.optargs,
+        REG_EXTENDED | (flag_chk(FLAG_x) ? 0 : REG_NOSUB))) != 0) {
       char errbuf[256];
-      (void) regerror(eval, &rp, errbuf, sizeof(errbuf));
+      (void) regerror(eval, &rp.re, errbuf, sizeof(errbuf));
       error_exit("%s", errbuf);
     }
   }
@@ -159,7 +160,7 @@ cmdline_fail:
     exec_action(latest_pid, latest_cmdline, signum);
     free(latest_cmdline);
   }
-  if (*toys.optargs) regfree(&rp);
+  if (*toys.optargs) regdfa_free(&rp);
   closedir(dp);
   toys.exitval = ret;
 }
@@ -45,7 +45,8 @@ GLOBALS(
   struct arg_list *exc;
 
   struct arg_list *inc, *pass;
-  void *inodes, *handle;
+  struct ino_hash inodes;
+  void *handle;
 )
 
 struct tar_hdr {
@@ -71,13 +72,6 @@ struct archive_handler {
   void (*extract_handler)(struct archive_handler*);
 };
 
-struct inode_list {
-  struct inode_list *next;
-  char *arg;
-  ino_t ino;
-  dev_t dev;
-};
-
 static void copy_in_out(int src, int dst, off_t size)
 {
   int i, rd, rem = size%512, cnt;
@@ -102,26 +96,6 @@ static void itoo(char *str, int len, off_t val)
   memcpy(str, t, len);
 }
 
-static struct inode_list *seen_inode(void **list, struct stat *st, char *name)
-{
-  if (!st) llist_traverse(*list, llist_free_arg);
-  else if (!S_ISDIR(st->st_mode) && st->st_nlink > 1) {
-    struct inode_list *new;
-
-    for (new = *list; new; new = new->next)
-      if(new->ino == st->st_ino && new->dev == st->st_dev)
-        return new;
-
-    new = xzalloc(sizeof(*new));
-    new->ino = st->st_ino;
-    new->dev = st->st_dev;
-    new->arg = xstrdup(name);
-    new->next = *list;
-    *list = new;
-  }
-  return 0;
-}
-
 static void write_longname(struct archive_handler *tar, char *name, char type)
 {
   struct tar_hdr tmp;
@@ -163,7 +137,7 @@ static void add_file(struct archive_handler *tar, char **nam, struct stat *st)
   struct tar_hdr hdr;
   struct passwd *pw;
   struct group *gr;
-  struct inode_list *node;
+  void **seen;
   int i, fd =-1;
   char *c, *p, *name = *nam, *lnk, *hname, buf[512] = {0,};
   unsigned int sum = 0;
@@ -198,12 +172,17 @@ static void add_file(struct archive_handler *tar, char **nam, struct stat *st)
   itoo(hdr.mtime, sizeof(hdr.mtime), st->st_mtime);
   for (i=0; i<sizeof(hdr.chksum); i++) hdr.chksum[i] = ' ';
 
-  if ((node = seen_inode(&TT.inodes, st, hname))) {
+  // Remember first name of each inode, later names are hard links to it
+  if ((seen = ino_hash(&TT.inodes, st)) && !*seen) {
+    *seen = xstrdup(hname);
+    seen = 0;
+  }
+  if (seen) {
     //this is a hard link
     hdr.type = '1';
-    if (strlen(node->arg) > sizeof(hdr.link))
+    if (strlen(*seen) > sizeof(hdr.link))
       write_longname(tar, hname, 'K'); //write longname LINK
-    xstrncpy(hdr.link, node->arg, sizeof(hdr.link));
+    xstrncpy(hdr.link, *seen, sizeof(hdr.link));
   } else if (S_ISREG(st->st_mode)) {
     hdr.type = '0';
     if (st->st_size <= (off_t)0777777777777LL)
@@ -464,14 +443,15 @@ static void add_from_file(struct arg_list **llist, struct arg_list *flist)
   char *line = NULL;
 
   while (flist) {
+    struct linebuf *lb;
     int fd = 0;
 
     if (strcmp((char *)flist->arg, "-"))
       fd = xopen((char *)flist->arg, O_RDONLY);
 
-    while ((line = get_line(fd))) {
-      add_to_list(llist, line);
-    }
+    lb = linebuf_new(fd);
+    while ((line = linebuf_line(lb))) add_to_list(llist, xstrdup(line));
+    linebuf_free(lb);
     if (fd) close(fd);
     flist = flist->next;
   }
@@ -793,7 +773,7 @@ void tar_main(void)
     }
     memset(toybuf, 0, 1024);
     writeall(tar_hdl->src_fd, toybuf, 1024);
-    seen_inode(&TT.inodes, 0, 0);
+    ino_hash_free(&TT.inodes, free);
   }
 
   if (CFG_TOYBOX_FREE) {
@@ -459,9 +459,11 @@ static int print_header(struct sysinfo *info, unsigned int cols)
   long unsigned total, meminfo_cached, anon, meminfo_mapped,
        meminfo_slab, meminfo_dirty, meminfo_writeback, swapT, swapF;
   char *buff;
+  struct linebuf *lb;
 
   fd = xopen("/proc/meminfo", O_RDONLY);
-  while ((buff = get_line(fd))) {
+  lb = linebuf_new(fd);
+  while ((buff = linebuf_line(lb))) {
     if (!strncmp(buff, "Cached", 6))
       sscanf(buff,"%*s %lu\n",&meminfo_cached);
     else if (!strncmp(buff, "AnonPages", 9))
@@ -478,8 +480,8 @@ static int print_header(struct sysinfo *info, unsigned int cols)
       sscanf(buff,"%*s %lu\n",&swapT);
     else if (!strncmp(buff, "SwapFree", 8))
       sscanf(buff,"%*s %lu\n",&swapF);
-    free(buff);
   }
+  linebuf_free(lb);
   close(fd);
 
   if (!(toys.optflags & FLAG_b)) printf("\033[H\033[J");
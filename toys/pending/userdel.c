@@ -26,6 +26,7 @@ static void update_groupfiles(char *filename, char* username)
 {
   char *filenamesfx = NULL, *sfx = NULL, *line = NULL;
   FILE *exfp, *newfp;
+  struct linebuf *lb;
   int ulen = strlen(username);
   struct flock lock;
 
@@ -49,9 +50,10 @@ static void update_groupfiles(char *filename, char* username)
 
   newfp = xfopen(filenamesfx, "w+");
 
-  while ((line = get_line(fileno(exfp))) != NULL){
+  lb = linebuf_new(fileno(exfp));
+  while ((line = linebuf_line(lb)) != NULL){
     sprintf(toybuf, "%s:",username);
-    if (!strncmp(line, toybuf, ulen+1)) goto LOOP;
+    if (!strncmp(line, toybuf, ulen+1)) continue;
     else {
       char *n, *p = strrchr(line, ':');
 
@@ -72,9 +74,8 @@ static void update_groupfiles(char *filename, char* username)
         if (!n) fprintf(newfp, "%s\n", line);
       } else fprintf(newfp, "%s\n", line);
     }
-LOOP:
-    free(line);
   }
+  linebuf_free(lb);
   fcntl(fileno(exfp), F_SETLK, &lock);
   fclose(exfp);
   errno = 0;
@@ -171,18 +171,9 @@ void xz_dec_end(struct xz_dec *s);
  * calculation, the third argument must be zero. To continue the calculation,
  * the previously returned value is passed as the third argument.
  */
-static uint32_t xz_crc32_table[256];
-
 uint32_t xz_crc32(const uint8_t *buf, size_t size, uint32_t crc)
 {
-  crc = ~crc;
-
-  while (size != 0) {
-    crc = xz_crc32_table[*buf++ ^ (crc & 0xFF)] ^ (crc >> 8);
-    --size;
-  }
-
-  return ~crc;
+  return ~crc32_le(~crc, (void *)buf, size);
 }
 
 static uint64_t xz_crc64_table[256];
@@ -200,7 +191,6 @@ void do_xzcat(int fd, char *name)
   enum xz_ret ret;
   const char *msg;
 
-  crc_init(xz_crc32_table, 1);
   const uint64_t poly = 0xC96C5795D7870F42ULL;
   uint32_t i;
   uint32_t j;
@@ -2578,15 +2568,17 @@ static enum xz_ret dec_block(struct xz_dec *s, struct xz_buf *b)
   if (s->check_type == XZ_CHECK_CRC32)
     s->crc = xz_crc32(b->out + s->out_start,
         b->out_pos - s->out_start, s->crc);
-  else if (s->check_type == XZ_CHECK_CRC64)
-    s->crc = ~(s->crc);
+  else if (s->check_type == XZ_CHECK_CRC64) {
     size_t size = b->out_pos - s->out_start;
     uint8_t *buf = b->out + s->out_start;
+
+    s->crc = ~(s->crc);
     while (size) {
       s->crc = xz_crc64_table[*buf++ ^ (s->crc & 0xFF)] ^ (s->crc >> 8);
       --size;
     }
     s->crc=~(s->crc);
+  }
 
   if (ret == XZ_STREAM_END) {
     if (s->block_header.compressed != VLI_UNKNOWN
@@ -25,38 +25,24 @@ config CKSUM
 #define FOR_cksum
 #include "toys.h"
 
-GLOBALS(
-  unsigned crc_table[256];
-)
-
-static unsigned cksum_be(unsigned crc, unsigned char c)
-{
-  return (crc<<8)^TT.crc_table[(crc>>24)^c];
-}
-
-static unsigned cksum_le(unsigned crc, unsigned char c)
-{
-  return TT.crc_table[(crc^c)&0xff] ^ (crc>>8);
-}
-
 static void do_cksum(int fd, char *name)
 {
   unsigned crc = (toys.optflags & FLAG_P) ? 0xffffffff : 0;
   uint64_t llen = 0, llen2;
-  unsigned (*cksum)(unsigned crc, unsigned char c);
+  unsigned (*cksum)(unsigned crc, void *data, unsigned long len);
 
-  cksum = (toys.optflags & FLAG_L) ? cksum_le : cksum_be;
+  cksum = (toys.optflags & FLAG_L) ? crc32_le : crc32_be;
   // CRC the data
 
   for (;;) {
-    int len, i;
+    int len;
 
     len = read(fd, toybuf, sizeof(toybuf));
     if (len<0) perror_msg("%s", name);
     if (len<1) break;
 
     llen += len;
-    for (i=0; i<len; i++) crc=cksum(crc, toybuf[i]);
+    crc = cksum(crc, toybuf, len);
   }
 
   // CRC the length
@@ -64,7 +50,9 @@ static void do_cksum(int fd, char *name)
   llen2 = llen;
   if (!(toys.optflags & FLAG_N)) {
     while (llen) {
-      crc = cksum(crc, llen);
+      unsigned char c = llen;
+
+      crc = cksum(crc, &c, 1);
       llen >>= 8;
     }
   }
@@ -78,6 +66,5 @@ static void do_cksum(int fd, char *name)
 
 void cksum_main(void)
 {
-  crc_init(TT.crc_table, toys.optflags & FLAG_L);
   loopfiles(toys.optargs, do_cksum);
 }
@@ -41,6 +41,7 @@ static void writeline(const char *line, int col)
 
 void comm_main(void)
 {
+  struct linebuf *lb[2];
   int file[2];
   char *line[2];
   int i;
@@ -50,7 +51,8 @@ void comm_main(void)
   for (i = 0; i < 2; i++) {
     file[i] = strcmp("-", toys.optargs[i])
       ? xopen(toys.optargs[i], O_RDONLY) : 0;
-    line[i] = get_line(file[i]);
+    lb[i] = linebuf_new(file[i]);
+    line[i] = linebuf_line(lb[i]);
   }
 
   while (line[0] && line[1]) {
@@ -59,23 +61,23 @@ void comm_main(void)
     if (order == 0) {
       writeline(line[0], 2);
       for (i = 0; i < 2; i++) {
-        free(line[i]);
-        line[i] = get_line(file[i]);
+        line[i] = linebuf_line(lb[i]);
       }
     } else {
       i = order < 0 ? 0 : 1;
       writeline(line[i], i);
-      free(line[i]);
-      line[i] = get_line(file[i]);
+      line[i] = linebuf_line(lb[i]);
     }
   }
 
   /* print rest of the longer file */
   for (i = line[0] ? 0 : 1; line[i];) {
     writeline(line[i], i);
-    free(line[i]);
-    line[i] = get_line(file[i]);
+    line[i] = linebuf_line(lb[i]);
   }
 
-  if (CFG_TOYBOX_FREE) for (i = 0; i < 2; i++) xclose(file[i]);
+  if (CFG_TOYBOX_FREE) for (i = 0; i < 2; i++) {
+    linebuf_free(lb[i]);
+    xclose(file[i]);
+  }
 }
@@ -120,8 +120,22 @@ GLOBALS(
   uid_t uid;
   gid_t gid;
   int pflags;
+  struct ino_hash links;
 )
 
+// Path try is being copied to
+static char *cp_destpath(struct dirtree *try)
+{
+  char *s, *ss;
+
+  if (!try->parent) return xstrdup(TT.destname);
+  s = cp_destpath(try->parent);
+  ss = xmprintf("%s/%s", s, try->name);
+  free(s);
+
+  return ss;
+}
+
 // Callback from dirtree_read() for each file/directory under a source dir.
 
 int cp_node(struct dirtree *try)
@@ -131,6 +145,7 @@ int cp_node(struct dirtree *try)
   unsigned flags = toys.optflags;
   char *catch = try->parent ? try->name : TT.destname, *err = "%s";
   struct stat cst;
+  void **seen = 0;
 
   if (!dirtree_notdotdot(try)) return 0;
 
@@ -177,11 +192,11 @@ int cp_node(struct dirtree *try)
       }
     }
 
-    if (flags & FLAG_v) {
-      char *s = dirtree_path(try, 0);
-      printf("%s '%s'\n", toys.which->name, s);
-      free(s);
-    }
+    if (flags & FLAG_v)
+      printf("%s '%s'\n", toys.which->name, dirtree_pathbuf(try));
+
+    // -a preserves hardlinks within the copy
+    if (flags & FLAG_a) seen = ino_hash(&TT.links, &try->st);
 
     // Loop for -f retry after unlink
     do {
@@ -212,6 +227,11 @@ int cp_node(struct dirtree *try)
               return DIRTREE_COMEAGAIN
                      | (DIRTREE_SYMFOLLOW*!!(toys.optflags&FLAG_L));
 
+      // Another name for something we already copied
+
+      } else if (seen && *seen) {
+        if (!linkat(AT_FDCWD, *seen, cfd, catch, 0)) err = 0;
+
       // Hardlink
 
       } else if (flags & FLAG_l) {
@@ -277,6 +297,7 @@ int cp_node(struct dirtree *try)
         close(fdin);
       }
     } while (err && (flags & (FLAG_f|FLAG_n)) && !unlinkat(cfd, catch, 0));
+    if (!err && seen && !*seen) *seen = cp_destpath(try);
   }
 
   // Did we make a thing?
@@ -398,6 +419,7 @@ void cp_main(void)
     }
     if (destdir) free(TT.destname);
   }
+  if (CFG_TOYBOX_FREE) ino_hash_free(&TT.links, free);
 }
 
 void mv_main(void)
@@ -127,6 +127,7 @@ static void get_data(void)
 static void do_fcut(int fd)
 {
   char *buff, *pfield = 0, *delimiter = TT.delim;
+  struct linebuf *lb = linebuf_new(fd);
 
   for (;;) {
     unsigned cpos = 0;
@@ -137,7 +138,7 @@ static void do_fcut(int fd)
     free(pfield);
     pfield = 0;
 
-    if (!(buff = get_line(fd))) break;
+    if (!(buff = linebuf_line(lb))) break;
 
     //does line have any delimiter?.
     if (strrchr(buff, (int)delimiter[0]) == NULL) {
@@ -182,14 +183,16 @@ static void do_fcut(int fd)
     }
     xputc('\n');
   }
+  linebuf_free(lb);
 }
 
 // perform cut operation char or byte.
 static void do_bccut(int fd)
 {
+  struct linebuf *lb = linebuf_new(fd);
   char *buff;
 
-  while ((buff = get_line(fd)) != NULL) {
+  while ((buff = linebuf_line(lb)) != NULL) {
     unsigned cpos = 0;
     int buffln = strlen(buff);
     char *pfield = xzalloc(buffln + 1);
@@ -224,6 +227,7 @@ static void do_bccut(int fd)
     free(pfield);
     pfield = NULL;
   }
+  linebuf_free(lb);
 }
 
 void cut_main(void)
@@ -41,7 +41,7 @@ GLOBALS(
 
   long depth, total;
   dev_t st_dev;
-  void *inodes;
+  struct ino_hash inodes;
 )
 
 typedef struct node_size {
@@ -67,40 +67,8 @@ static void print(long long size, struct dirtree *node)
 
     printf("%llu", (size>>bits)+!!(size&((1<<bits)-1)));
   }
-  if (node) name = dirtree_path(node, NULL);
+  if (node) name = dirtree_pathbuf(node);
   xprintf("\t%s\n", name);
-  if (node) free(name);
-}
-
-// Return whether or not we've seen this inode+dev, adding it to the list if
-// we haven't.
-static int seen_inode(void **list, struct stat *st)
-{
-  if (!st) llist_traverse(st, free);
-
-  // Skipping dir nodes isn't _quite_ right. They're not hardlinked, but could
-  // be bind mounted. Still, it's more efficient and the archivers can't use
-  // hardlinked directory info anyway. (Note that we don't catch bind mounted
-  // _files_ because it doesn't change st_nlink.)
-  else if (!S_ISDIR(st->st_mode) && st->st_nlink > 1) {
-    struct inode_list {
-      struct inode_list *next;
-      ino_t ino;
-      dev_t dev;
-    } *new;
-
-    for (new = *list; new; new = new->next)
-      if(new->ino == st->st_ino && new->dev == st->st_dev)
-        return 1;
-
-    new = xzalloc(sizeof(*new));
-    new->ino = st->st_ino;
-    new->dev = st->st_dev;
-    new->next = *list;
-    *list = new;
-  }
-
-  return 0;
 }
 
 // dirtree callback, comput/display size of node
@@ -123,8 +91,12 @@ static int do_du(struct dirtree *node)
   }
 
   // Don't count hard links twice
-  if (!(toys.optflags & FLAG_l) && !node->again)
-    if (seen_inode(&TT.inodes, &node->st)) return 0;
+  if (!(toys.optflags & FLAG_l) && !node->again) {
+    void **seen = ino_hash(&TT.inodes, &node->st);
+
+    if (seen && *seen) return 0;
+    if (seen) *seen = (void *)1;
+  }
 
   // Collect child info before printing directory size
   if (S_ISDIR(node->st.st_mode)) {
@@ -153,9 +125,9 @@ void du_main(void)
 
   // Loop over command line arguments, recursing through children
   for (args = toys.optc ? toys.optargs : noargs; *args; args++)
-    dirtree_handle_callback(dirtree_start(*args, toys.optflags&(FLAG_H|FLAG_L)),
-      do_du);
+    dirtree_flagread(*args, DIRTREE_PARALLEL
+      |DIRTREE_SYMFOLLOW*!!(toys.optflags&(FLAG_H|FLAG_L)), do_du);
   if (toys.optflags & FLAG_c) print(TT.total*512, 0);
 
-  if (CFG_TOYBOX_FREE) seen_inode(TT.inodes, 0);
+  if (CFG_TOYBOX_FREE) ino_hash_free(&TT.inodes, 0);
 }
@@ -135,10 +135,7 @@ static int compare_numsign(long val, long units, char *str)
 
 static void do_print(struct dirtree *new, char c)
 {
-  char *s=dirtree_path(new, 0);
-
-  xprintf("%s%c", s, c);
-  free(s);
+  xprintf("%s%c", dirtree_pathbuf(new), c);
 }
 
 // Call this with 0 for first pass argument parsing and syntax checking (which
@@ -150,12 +147,16 @@ static int do_find(struct dirtree *new)
   struct double_list *argdata = TT.argdata;
   char *s, **ss;
 
-  recurse = DIRTREE_COMEAGAIN|(DIRTREE_SYMFOLLOW*!!(toys.optflags&FLAG_L));
+  recurse = DIRTREE_COMEAGAIN|DIRTREE_LAZY
+    |(DIRTREE_SYMFOLLOW*!!(toys.optflags&FLAG_L));
 
   // skip . and .. below topdir, handle -xdev and -depth
   if (new) {
     if (new->parent) {
       if (!dirtree_notdotdot(new)) return 0;
+      // Lazy nodes only have the type, loop detection and -xdev need more
+      if ((TT.xdev || S_ISDIR(new->st.st_mode)) && dirtree_stat(new))
+        return 0;
       if (TT.xdev && new->st.st_dev != new->parent->st.st_dev) recurse = 0;
     }
     if (S_ISDIR(new->st.st_mode)) {
@@ -224,6 +225,15 @@ static int do_find(struct dirtree *new)
       continue;
     } else s++;
 
+    // Tests that look at more than name and type need the rest of stat
+    if (check && new->lazy) {
+      char *needstat[] = {"nouser", "nogroup", "perm", "atime", "ctime",
+        "mtime", "size", "links", "inum", "user", "group", "newer", 0}, **ns;
+
+      for (ns = needstat; *ns; ns++)
+        if (!strcmp(s, *ns) && dirtree_stat(new)) return 0;
+    }
+
     if (!strcmp(s, "xdev")) TT.xdev = 1;
     else if (!strcmp(s, "depth")) TT.depth = 1;
     else if (!strcmp(s, "o") || !strcmp(s, "or")) {
@@ -256,23 +266,20 @@ static int do_find(struct dirtree *new)
         || !strcmp(s, "path") || !strcmp(s, "ipath"))
       {
         int i = (*s == 'i');
-        char *arg = ss[1], *path = 0, *name = new->name;
+        char *arg = ss[1], *name = new ? new->name : 0;
 
         // Handle path expansion and case flattening
-        if (new && s[i] == 'p') name = path = dirtree_path(new, 0);
+        if (check && s[i] == 'p') name = dirtree_pathbuf(new);
         if (i) {
           if (check || !new) {
             name = strlower(new ? name : arg);
-            if (!new) {
-              dlist_add(&TT.argdata, name);
-              free(path);
-            } else arg = ((struct double_list *)llist_pop(&argdata))->data;
+            if (!new) dlist_add(&TT.argdata, name);
+            else arg = ((struct double_list *)llist_pop(&argdata))->data;
           }
         }
 
         if (check) {
           test = !fnmatch(arg, name, FNM_PATHNAME*(s[i] == 'p'));
-          free(path);
           if (i) free(name);
         }
       } else if (!strcmp(s, "perm")) {
@@ -479,7 +486,7 @@ error:
 
 void find_main(void)
 {
-  int i, len;
+  int i, len, flags;
   char **ss = toys.optargs;
 
   TT.topdir = -1;
@@ -499,10 +506,16 @@ void find_main(void)
   TT.now = time(0);
   do_find(0);
 
+  // Read directories ahead in threads, unless we fork children (-exec etc).
+  flags = DIRTREE_SYMFOLLOW*!!(toys.optflags&(FLAG_H|FLAG_L));
+  for (i = 0; TT.filter[i]; i++)
+    if (!strcmp(TT.filter[i], "-exec") || !strcmp(TT.filter[i], "-ok")
+      || !strcmp(TT.filter[i], "-execdir") || !strcmp(TT.filter[i], "-okdir"))
+        break;
+  if (!TT.filter[i]) flags |= DIRTREE_PARALLEL;
+
   // Loop through paths
-  for (i = 0; i < len; i++)
-    dirtree_handle_callback(dirtree_start(ss[i], toys.optflags&(FLAG_H|FLAG_L)),
-      do_find);
+  for (i = 0; i < len; i++) dirtree_flagread(ss[i], flags, do_find);
 
   if (CFG_TOYBOX_FREE) {
     close(TT.topdir);
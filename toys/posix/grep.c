@@ -4,7 +4,7 @@
  *
  * See http://pubs.opengroup.org/onlinepubs/9699919799/utilities/grep.html
 
-USE_GREP(NEWTOY(grep, "ZzEFHabhinorsvwclqe*f*m#x[!wx][!EFw]", TOYFLAG_BIN))
+USE_GREP(NEWTOY(grep, USE_GREP_PARALLEL("(parallel)#<1(ordered)")"ZzEFHabhinorsvwclqe*f*m#x[!wx][!EFw]", TOYFLAG_BIN))
 USE_EGREP(OLDTOY(egrep, grep, TOYFLAG_BIN))
 USE_FGREP(OLDTOY(fgrep, grep, TOYFLAG_BIN))
 
@@ -37,6 +37,16 @@ config GREP
     -H  force filename           -b  byte offset of match
     -h  hide filename            -n  line number of match
 
+config GREP_PARALLEL
+  bool
+  default y
+  depends on GREP && TOYBOX_THREADS
+  help
+    usage: grep [--parallel=N [--ordered]]
+
+    --parallel=N  search -r files with N threads (output per file, unordered)
+    --ordered     with --parallel, output in the same order as without
+
 config EGREP
   bool
   default y
@@ -57,136 +67,482 @@ GLOBALS(
   struct arg_list *f;
   struct arg_list *e;
 
-  struct arg_list *regex;
+  long parallel;
+
+  char *regstr, *lit;
+  long litlen;
+
+  // -F matching: a literal (searched with Boyer-Moore-Horspool for -i) or
+  // an Aho-Corasick automaton for multiple patterns.
+  struct fgrep_node *fnodes;
+  int fcount, fempty, fclasses, *fdelta;
+  char *fpat;
+  long flen, *fskip;
+  unsigned char fold[256], fclass[256];
+
+  // --parallel job queue: jobs in search order, todo is the first unstarted.
+  struct grep_job *jobs, *last, *todo;
+  int threads, inflight, finished;
+  pthread_mutex_t lock;
+  pthread_cond_t wake, room;
 )
 
-static void do_grep(int fd, char *name)
+struct grep_job {
+  struct grep_job *next;
+  char *name, *buf;
+  size_t len;
+  int fd, done;
+};
+
+// Aho-Corasick trie node. Node 0 is the root.
+struct fgrep_node {
+  int child, next;  // first child, next sibling (only used while building)
+  int fail;         // node for the longest proper suffix that's in the trie
+  int depth;        // length of string this node matches
+  int len;          // length of longest pattern that's a suffix of that, or 0
+  unsigned char c;  // byte class leading here
+};
+
+static int fgrep_child(int node, unsigned char c)
 {
-  FILE *file = fdopen(fd, "r");
-  long offset = 0;
-  int lcount = 0, mcount = 0, which = toys.optflags & FLAG_w ? 2 : 0;
-  char indelim = '\n' * !(toys.optflags&FLAG_z),
-       outdelim = '\n' * !(toys.optflags&FLAG_Z);
+  for (node = TT.fnodes[node].child; node; node = TT.fnodes[node].next)
+    if (TT.fnodes[node].c == c) return node;
 
-  if (!fd) name = "(standard input)";
+  return 0;
+}
+
+// Build matcher for TT.e's fixed strings
+static void fgrep_init(void)
+{
+  struct arg_list *al;
+  int i, j, max = 1, *queue, qhead, qtail;
+
+  for (i = 0; i<256; i++)
+    TT.fold[i] = (toys.optflags & FLAG_i) ? tolower(i) : i;
+
+  for (i = 0, al = TT.e; al; al = al->next) {
+    if (!*al->arg) TT.fempty++;
+    else i++, max += strlen(al->arg);
+  }
+  // A few patterns are faster with libc's strstr() each, and one -i pattern
+  // gets Boyer-Moore-Horspool.
+  if (i<2 || (i<5 && !(toys.optflags & FLAG_i))) {
+    if (i == 1 && (toys.optflags & FLAG_i)) {
+      for (al = TT.e; !*al->arg; al = al->next);
+      TT.fpat = al->arg;
+      TT.flen = strlen(TT.fpat);
+
+      // Bad character skip table, by folded byte
+      TT.fskip = xmalloc(256*sizeof(long));
+      for (i = 0; i<256; i++) TT.fskip[i] = TT.flen;
+      for (i = 0; i<TT.flen-1; i++)
+        TT.fskip[TT.fold[(unsigned char)TT.fpat[i]]] = TT.flen-1-i;
+    }
 
-  if (!file) {
-    perror_msg("%s", name);
     return;
   }
 
-  for (;;) {
-    char *line = 0, *start;
-    regmatch_t matches[3];
-    size_t unused;
-    long len;
-    int mmatch = 0;
+  // Bytes that appear in no pattern all act the same, so number the ones
+  // that do (after folding) to shrink the transition table. Class 0 is other.
+  for (al = TT.e; al; al = al->next) {
+    unsigned char *s = (void *)al->arg;
 
-    lcount++;
-    if (0 > (len = getdelim(&line, &unused, indelim, file))) break;
-    if (line[len-1] == indelim) line[len-1] = 0;
+    for (; *s; s++) TT.fclass[TT.fold[*s]] = 1;
+  }
+  for (i = TT.fclasses = 1; i<256; i++)
+    if (TT.fclass[i]) TT.fclass[i] = TT.fclasses++;
+  for (i = 0; i<256; i++) TT.fclass[i] = TT.fclass[TT.fold[i]];
+
+  // Build the trie
+  TT.fnodes = xzalloc(max*sizeof(struct fgrep_node));
+  TT.fcount = 1;
+  for (al = TT.e; al; al = al->next) {
+    unsigned char *s = (void *)al->arg;
+    int node = 0, next;
+
+    if (!*s) continue;
+    for (; *s; s++, node = next) {
+      if (!(next = fgrep_child(node, TT.fclass[*s]))) {
+        struct fgrep_node *new = TT.fnodes+(next = TT.fcount++);
+
+        new->c = TT.fclass[*s];
+        new->depth = TT.fnodes[node].depth+1;
+        new->next = TT.fnodes[node].child;
+        TT.fnodes[node].child = next;
+      }
+    }
+    TT.fnodes[node].len = TT.fnodes[node].depth;
+  }
 
-    start = line;
+  // Fill in the full transition table breadth first, so failure links (and
+  // the transitions they inherit) point to nodes already done.
+  TT.fdelta = xmalloc(TT.fcount*TT.fclasses*sizeof(int));
+  queue = xmalloc(TT.fcount*sizeof(int));
+  queue[0] = 0;
+  for (qhead = 0, qtail = 1; qhead<qtail; qhead++) {
+    struct fgrep_node *node = TT.fnodes+queue[qhead];
+    int *delta = TT.fdelta+queue[qhead]*TT.fclasses,
+        *fail = TT.fdelta+node->fail*TT.fclasses;
+
+    if (!node->len) node->len = TT.fnodes[node->fail].len;
+    for (j = 0; j<TT.fclasses; j++) delta[j] = qhead ? fail[j] : 0;
+    for (i = node->child; i; i = TT.fnodes[i].next) {
+      TT.fnodes[i].fail = qhead ? fail[TT.fnodes[i].c] : 0;
+      delta[TT.fnodes[i].c] = i;
+      queue[qtail++] = i;
+    }
+  }
+  free(queue);
+}
 
-    for (;;)
+// Find leftmost (then longest) fixed string in line, setting match offsets.
+// Returns 0 if found, like regexec().
+static int fgrep_match(char *line, regmatch_t *m)
+{
+  unsigned char *s = (void *)line;
+  long i, start = -1;
+  int node = 0;
+
+  // '' matches the whole line
+  if (TT.fempty) {
+    m->rm_so = 0;
+    m->rm_eo = strlen(line);
+
+    return 0;
+  }
+
+  if (TT.fcount) {
+    for (i = 0; s[i]; i++) {
+      struct fgrep_node *n;
+
+      // Skip along quickly while nothing's started
+      if (!node) {
+        while (s[i] && !TT.fdelta[TT.fclass[s[i]]]) i++;
+        if (!s[i]) break;
+      }
+      n = TT.fnodes+(node = TT.fdelta[node*TT.fclasses+TT.fclass[s[i]]]);
+
+      // Longest match ending here starts leftmost. Once everything we could
+      // still be matching starts after the best so far, it's the answer.
+      if (n->len && (start<0 || i+1-n->len <= start)) {
+        m->rm_eo = i+1;
+        m->rm_so = start = i+1-n->len;
+      }
+      if (start>=0 && start < i+1-n->depth) break;
+    }
+
+    return start<0;
+  }
+
+  if (!TT.fpat) {
+    struct arg_list *al;
+
+    // Leftmost, then longest
+    for (al = TT.e; al; al = al->next) {
+      char *found;
+      long len = strlen(al->arg);
+
+      if (!(found = strstr(line, al->arg))) continue;
+      i = found-line;
+      if (start<0 || i<start || (i==start && i+len>m->rm_eo)) {
+        m->rm_so = start = i;
+        m->rm_eo = i+len;
+      }
+    }
+
+    return start<0;
+  } else {
+    long len = strlen(line);
+
+    for (line = 0, i = 0; i+TT.flen <= len;
+      i += TT.fskip[TT.fold[s[i+TT.flen-1]]])
     {
-      int rc = 0, skip = 0;
+      long j = TT.flen;
+
+      while (j-- && TT.fold[s[i+j]] == TT.fold[(unsigned char)TT.fpat[j]]);
+      if (j<0) {
+        line = (char *)s+i;
+        break;
+      }
+    }
+  }
+  if (!line) return 1;
+  m->rm_so = line-(char *)s;
+  m->rm_eo = m->rm_so+TT.flen;
 
-      if (toys.optflags & FLAG_F) {
-        struct arg_list *seek, fseek;
-        char *s = 0;
+  return 0;
+}
 
-        for (seek = TT.e; seek; seek = seek->next) {
-          if (toys.optflags & FLAG_x) {
-            int i = (toys.optflags & FLAG_i);
+// Find the longest string every match of regex re must contain, so lines
+// without it can be skipped without running the regex. Returns its length.
+static long grep_literal(char *re, int ere, char *best)
+{
+  char *cur = xmalloc(strlen(re)+1);
+  long len = 0, blen = 0, depth = 0;
 
-            if ((i ? strcasecmp : strcmp)(seek->arg, line)) s = line;
-          } else if (!*seek->arg) {
-            seek = &fseek;
-            fseek.arg = s = line;
-            break;
-          }
-          if (toys.optflags & FLAG_i) {
-            long ll = strlen(seek->arg);;
-
-            // Alas, posix hasn't got strcasestr()
-            for (s = line; *s; s++) if (!strncasecmp(s, seek->arg, ll)) break;
-            if (!*s) s = 0;
-          } else s = strstr(line, seek->arg);
-          if (s) break;
+  for (;;) {
+    int c = *re++, special;
+
+    if (c == '\\') {
+      if (!(c = *re++)) break;
+      special = isalnum(c) || strchr("<>`'", c)
+        || (!ere && strchr("(){}|+?", c));
+    } else special = c && strchr(ere ? ".[*^$(){}|+?" : ".[*^$", c);
+
+    // Literal bytes outside groups extend the current run.
+    if (c && !special) {
+      if (!depth) cur[len++] = c;
+      continue;
+    }
+
+    // Anything else ends it, and a repeat makes the char before it optional.
+    if (c == '*' || c == '?' || c == '{') {
+      while (len && (cur[len-1]&0xc0) == 0x80) len--;
+      if (len) len--;
+    }
+    if (len>blen) memcpy(best, cur, blen = len);
+    len = 0;
+    if (!c) break;
+
+    if (c == '|') {
+      blen = 0;
+      break;
+    } else if (c == '(') depth++;
+    else if (c == ')') depth--;
+    else if (c == '{') {
+      while (*re && *re != '}') re++;
+      if (*re) re++;
+    } else if (c == '[') {
+      if (*re == '^') re++;
+      if (*re == ']') re++;
+      while (*re && *re != ']') {
+        if (*re == '[' && strchr(":=.", re[1]) && re[1]) {
+          char *end = re+2;
+
+          while (*end && (*end != re[1] || end[1] != ']')) end++;
+          re = *end ? end+2 : end;
+        } else re++;
+      }
+      if (*re) re++;
+    }
+  }
+  free(cur);
+
+  return blen;
+}
+
+// Search fd, writing results to out, using regex re (unless -F)
+static void grep_fd(int fd, char *name, FILE *out, struct regdfa *re)
+{
+  char *buf = 0, *line, *end, *next;
+  long size = 0, used = 0, offset = 0, len;
+  int lcount = 0, mcount = 0, which = toys.optflags & FLAG_w ? 2 : 0, eof = 0;
+  char indelim = '\n' * !(toys.optflags&FLAG_z),
+       outdelim = '\n' * !(toys.optflags&FLAG_Z);
+
+  if (!fd) name = "(standard input)";
+
+  // Read big blocks, and only look at lines containing the required literal
+  // (if any). The rest are skipped by counting delimiters, if that.
+  while (!eof) {
+    if (used == size) buf = xrealloc(buf, (size = size ? 2*size : 65536)+1);
+    if (0 > (len = read(fd, buf+used, size-used))) {
+      perror_msg("%s", name);
+      break;
+    }
+    if (!len) eof++;
+    end = buf+(used += len);
+
+    for (line = buf; line<end; line = next+(next<end)) {
+      char *start;
+      regmatch_t matches[3];
+      int mmatch = 0;
+
+      if (TT.litlen) {
+        char *hit = memmem(line, end-line, TT.lit, TT.litlen), *s;
+
+        // Skip to the start of the line with the hit, or whole lines to end
+        if (!(s = hit)) s = end;
+        while (s>line && s[-1] != indelim) s--;
+        if (toys.optflags & FLAG_n)
+          for (next = line; (next = memchr(next, indelim, s-next)); next++)
+            lcount++;
+        offset += s-line;
+        line = s;
+        if (!hit) {
+          if (eof) line = end;
+          break;
         }
+      }
 
-        if (s) {
-          matches[which].rm_so = (s-line);
-          skip = matches[which].rm_eo = (s-line)+strlen(seek->arg);
-        } else rc = 1;
-      } else {
-        rc = regexec((regex_t *)toybuf, start, 3, matches,
-                     start==line ? 0 : REG_NOTBOL);
-        skip = matches[which].rm_eo;
+      if (!(next = memchr(line, indelim, end-line))) {
+        if (!eof) break;
+        next = end;
       }
+      *next = 0;
+      start = line;
+      lcount++;
 
-      if (toys.optflags & FLAG_x)
-        if (matches[which].rm_so || line[matches[which].rm_eo]) rc = 1;
+      for (;;)
+      {
+        int rc = 0, skip = 0;
 
-      if (toys.optflags & FLAG_v) {
-        if (toys.optflags & FLAG_o) {
-          if (rc) skip = matches[which].rm_eo = strlen(start);
-          else if (!matches[which].rm_so) {
-            start += skip;
-            continue;
-          } else matches[which].rm_eo = matches[which].rm_so;
+        if (toys.optflags & FLAG_F) {
+          rc = fgrep_match(start, matches+which);
+          skip = matches[which].rm_eo;
         } else {
-          if (!rc) break;
-          matches[which].rm_eo = strlen(start);
+          rc = regdfa_exec(re, start, which+1, matches,
+                           start==line ? 0 : REG_NOTBOL);
+          skip = matches[which].rm_eo;
         }
-        matches[which].rm_so = 0;
-      } else if (rc) break;
-
-      mmatch++;
-      toys.exitval = 0;
-      if (toys.optflags & FLAG_q) xexit();
-      if (toys.optflags & FLAG_l) {
-        printf("%s%c", name, outdelim);
-        free(line);
-        fclose(file);
-        return;
-      }
-      if (toys.optflags & FLAG_o)
-        if (matches[which].rm_eo == matches[which].rm_so)
-          break;
 
-      if (!(toys.optflags & FLAG_c)) {
-        if (toys.optflags & FLAG_H) printf("%s:", name);
-        if (toys.optflags & FLAG_n) printf("%d:", lcount);
-        if (toys.optflags & FLAG_b)
-          printf("%ld:", offset + (start-line) +
-              ((toys.optflags & FLAG_o) ? matches[which].rm_so : 0));
-        if (!(toys.optflags & FLAG_o)) xprintf("%s%c", line, outdelim);
-        else {
-          xprintf("%.*s%c", matches[which].rm_eo - matches[which].rm_so,
-                  start + matches[which].rm_so, outdelim);
+        if (toys.optflags & FLAG_x)
+          if (matches[which].rm_so || line[matches[which].rm_eo]) rc = 1;
+
+        if (toys.optflags & FLAG_v) {
+          if (toys.optflags & FLAG_o) {
+            if (rc) skip = matches[which].rm_eo = strlen(start);
+            else if (!matches[which].rm_so) {
+              start += skip;
+              continue;
+            } else matches[which].rm_eo = matches[which].rm_so;
+          } else {
+            if (!rc) break;
+            matches[which].rm_eo = strlen(start);
+          }
+          matches[which].rm_so = 0;
+        } else if (rc) break;
+
+        mmatch++;
+        toys.exitval = 0;
+        if (toys.optflags & FLAG_q) xexit();
+        if (toys.optflags & FLAG_l) {
+          fprintf(out, "%s%c", name, outdelim);
+          free(buf);
+          return;
+        }
+        if (toys.optflags & FLAG_o)
+          if (matches[which].rm_eo == matches[which].rm_so)
+            break;
+
+        if (!(toys.optflags & FLAG_c)) {
+          if (toys.optflags & FLAG_H) fprintf(out, "%s:", name);
+          if (toys.optflags & FLAG_n) fprintf(out, "%d:", lcount);
+          if (toys.optflags & FLAG_b)
+            fprintf(out, "%ld:", offset + (start-line) +
+                ((toys.optflags & FLAG_o) ? matches[which].rm_so : 0));
+          if (!(toys.optflags & FLAG_o)) fprintf(out, "%s%c", line, outdelim);
+          else {
+            fprintf(out, "%.*s%c", matches[which].rm_eo - matches[which].rm_so,
+                    start + matches[which].rm_so, outdelim);
+          }
+          if (out == stdout) xflush();
         }
+
+        start += skip;
+        if (!(toys.optflags & FLAG_o) || !*start) break;
       }
+      offset += next+(next<end)-line;
 
-      start += skip;
-      if (!(toys.optflags & FLAG_o) || !*start) break;
+      if (mmatch) mcount++;
+      if ((toys.optflags & FLAG_m) && mcount >= TT.m) {
+        eof++;
+        break;
+      }
     }
-    offset += len;
-
-    free(line);
 
-    if (mmatch) mcount++;
-    if ((toys.optflags & FLAG_m) && mcount >= TT.m) break;
+    // Keep the partial line for next time.
+    memmove(buf, line, used = end-line);
   }
+  free(buf);
 
   if (toys.optflags & FLAG_c) {
-    if (toys.optflags & FLAG_H) printf("%s:", name);
-    xprintf("%d%c", mcount, outdelim);
+    if (toys.optflags & FLAG_H) fprintf(out, "%s:", name);
+    fprintf(out, "%d%c", mcount, outdelim);
+    if (out == stdout) xflush();
   }
+}
 
-  // loopfiles will also close the fd, but this frees an (opaque) struct.
-  fclose(file);
+static void do_grep(int fd, char *name)
+{
+  grep_fd(fd, name, stdout, (void *)toybuf);
+}
+
+// Compile TT.regstr into re
+static void grep_regcomp(struct regdfa *re)
+{
+  int rc = regdfa_comp(re, TT.regstr,
+    ((toys.optflags & FLAG_E) ? REG_EXTENDED : 0) |
+    ((toys.optflags & FLAG_i) ? REG_ICASE    : 0));
+
+  if (rc) {
+    regerror(rc, &re->re, libbuf, sizeof(libbuf));
+    error_exit("bad REGEX: %s", libbuf);
+  }
+}
+
+// --parallel: a worker thread searching queued files, each into its own
+// buffer so output doesn't interleave. Output goes out in queue order if
+// --ordered, else as each file finishes.
+static void *grep_worker(void *unused)
+{
+  struct grep_job *job;
+  struct regdfa re;
+  FILE *out;
+
+  if (!(toys.optflags & FLAG_F)) grep_regcomp(&re);
+  pthread_mutex_lock(&TT.lock);
+  for (;;) {
+    while (!(job = TT.todo) && !TT.finished)
+      pthread_cond_wait(&TT.wake, &TT.lock);
+    if (!job) break;
+    TT.todo = job->next;
+    pthread_mutex_unlock(&TT.lock);
+
+    out = open_memstream(&job->buf, &job->len);
+    grep_fd(job->fd, job->name, out, &re);
+    fclose(out);
+    if (job->fd>0) close(job->fd);
+
+    pthread_mutex_lock(&TT.lock);
+    job->done++;
+    if (!(toys.optflags & FLAG_ordered)) {
+      xwrite(1, job->buf, job->len);
+      job->len = 0;
+    }
+
+    // Retire finished jobs from the front, writing any output they saved.
+    while ((job = TT.jobs) && job->done) {
+      xwrite(1, job->buf, job->len);
+      if (!(TT.jobs = job->next)) TT.last = 0;
+      free(job->buf);
+      free(job->name);
+      free(job);
+      TT.inflight--;
+    }
+    pthread_cond_broadcast(&TT.room);
+  }
+  pthread_mutex_unlock(&TT.lock);
+
+  return 0;
+}
+
+// Queue an open file for grep_worker(), waiting while too many are pending.
+static void grep_queue(int fd, char *name)
+{
+  struct grep_job *job = xzalloc(sizeof(struct grep_job));
+
+  job->fd = fd;
+  job->name = xstrdup(name);
+  pthread_mutex_lock(&TT.lock);
+  while (TT.inflight >= 16*TT.threads) pthread_cond_wait(&TT.room, &TT.lock);
+  TT.inflight++;
+  if (TT.last) TT.last->next = job;
+  else TT.jobs = job;
+  TT.last = job;
+  if (!TT.todo) TT.todo = job;
+  pthread_cond_signal(&TT.wake);
+  pthread_mutex_unlock(&TT.lock);
 }
 
 static void parse_regex(void)
@@ -219,16 +575,23 @@ static void parse_regex(void)
   }
   TT.e = list;
 
-  if (!(toys.optflags & FLAG_F)) {
+  // A string every matching line contains lets do_grep() skip the rest unseen
+  if (TT.e && !TT.e->next && !(toys.optflags & (FLAG_i|FLAG_v))) {
+    TT.lit = xstrdup(TT.e->arg);
+    TT.litlen = (toys.optflags & FLAG_F) ? strlen(TT.lit)
+      : grep_literal(TT.e->arg, toys.optflags & FLAG_E, TT.lit);
+  }
+
+  if (toys.optflags & FLAG_F) fgrep_init();
+  else {
     int w = toys.optflags & FLAG_w;
-    char *regstr;
 
     // Convert strings to one big regex
     if (w) len = 36;
     for (al = TT.e; al; al = al->next)
       len += strlen(al->arg)+1+!(toys.optflags & FLAG_E);
 
-    regstr = s = xmalloc(len);
+    TT.regstr = s = xmalloc(len);
     if (w) s = stpcpy(s, "(^|[^_[:alnum:]])(");
     for (al = TT.e; al; al = al->next) {
       s = stpcpy(s, al->arg);
@@ -238,31 +601,26 @@ static void parse_regex(void)
     *(s-=(1+!(toys.optflags & FLAG_E))) = 0;
     if (w) strcpy(s, ")($|[^_[:alnum:]])");
 
-    w = regcomp((regex_t *)toybuf, regstr,
-                ((toys.optflags & FLAG_E) ? REG_EXTENDED : 0) |
-                ((toys.optflags & FLAG_i) ? REG_ICASE    : 0));
-
-    if (w) {
-      regerror(w, (regex_t *)toybuf, toybuf+sizeof(regex_t),
-               sizeof(toybuf)-sizeof(regex_t));
-      error_exit("bad REGEX: %s", toybuf);
-    }
+    grep_regcomp((void *)toybuf);
   }
 }
 
 static int do_grep_r(struct dirtree *new)
 {
-  char *name;
+  int fd;
 
   if (new->parent && !dirtree_notdotdot(new)) return 0;
-  if (S_ISDIR(new->st.st_mode)) return DIRTREE_RECURSE;
+  if (S_ISDIR(new->st.st_mode)) return DIRTREE_RECURSE|DIRTREE_LAZY;
 
   // "grep -r onefile" doesn't show filenames, but "grep -r onedir" should.
   if (new->parent && !(toys.optflags & FLAG_h)) toys.optflags |= FLAG_H;
 
-  name = dirtree_path(new, 0);
-  do_grep(openat(dirtree_parentfd(new), new->name, 0), name);
-  free(name);
+  fd = openat(dirtree_parentfd(new), new->name, 0);
+  if (TT.threads) grep_queue(fd, dirtree_pathbuf(new));
+  else {
+    do_grep(fd, dirtree_pathbuf(new));
+    if (fd>0) close(fd);
+  }
 
   return 0;
 }
@@ -294,9 +652,31 @@ void grep_main(void)
   }
 
   if (toys.optflags & FLAG_r) {
+    pthread_t *tids = 0;
+
+    // Find files in this thread and search them in others.
+    if (CFG_GREP_PARALLEL && TT.parallel>1) {
+      pthread_mutex_init(&TT.lock, 0);
+      pthread_cond_init(&TT.wake, 0);
+      pthread_cond_init(&TT.room, 0);
+      tids = xmalloc(TT.parallel*sizeof(pthread_t));
+      while (TT.threads<TT.parallel)
+        if (pthread_create(tids+TT.threads, 0, grep_worker, 0)) break;
+        else TT.threads++;
+    }
     for (ss = *ss ? ss : (char *[]){".", 0}; *ss; ss++) {
-      if (!strcmp(*ss, "-")) do_grep(0, *ss);
-      else dirtree_read(*ss, do_grep_r);
+      if (!strcmp(*ss, "-")) {
+        if (TT.threads) grep_queue(0, *ss);
+        else do_grep(0, *ss);
+      } else dirtree_read(*ss, do_grep_r);
+    }
+    if (TT.threads) {
+      pthread_mutex_lock(&TT.lock);
+      TT.finished++;
+      pthread_cond_broadcast(&TT.wake);
+      pthread_mutex_unlock(&TT.lock);
+      while (TT.threads) pthread_join(tids[--TT.threads], 0);
     }
+    free(tids);
   } else loopfiles_rw(ss, O_RDONLY, 0, 1, do_grep);
 }
@@ -312,7 +312,11 @@ static void listfiles(int dirfd, struct dirtree *indir)
     // Read directory contents. We dup() the fd because this will close it.
     // This reads/saves contents to display later, except for in "ls -1f" mode.
     indir->data = dup(dirfd);
-    dirtree_recurse(indir, filter, DIRTREE_SYMFOLLOW*!!(flags&FLAG_L));
+    // With -R, read subdirectories ahead in other threads. "ls -1f" only
+    // shows names, so doesn't need to stat anything.
+    dirtree_recurse(indir, filter, DIRTREE_SYMFOLLOW*!!(flags&FLAG_L)
+      |DIRTREE_PARALLEL*!!(flags&FLAG_R)
+      |DIRTREE_LAZY*(flags == (FLAG_1|FLAG_f)));
   }
 
   // Copy linked list to array and sort it. Directories go in array because
@@ -489,7 +493,7 @@ static void listfiles(int dirfd, struct dirtree *indir)
 
   // Free directory entries, recursing first if necessary.
 
-  for (ul = 0; ul<dtlen; free(sort[ul++])) {
+  for (ul = 0; ul<dtlen; dirtree_free(sort[ul++])) {
     if ((flags & FLAG_d) || !S_ISDIR(sort[ul]->st.st_mode)) continue;
 
     // Recurse into dirs if at top of the tree or given -R
@@ -51,6 +51,7 @@ GLOBALS(
   long prefix;
 
   struct double_list *current_hunk;
+  struct linebuf *linein, *linepatch;
   long oldline, oldlen, newline, newlen;
   long linenum;
   int context, state, filein, fileout, filepatch, hunknum;
@@ -86,6 +87,9 @@ static void do_line(void *data)
 
 static void finish_oldfile(void)
 {
+  // Give unused readahead back to filein so replace_tempfile() copies it.
+  linebuf_free(TT.linein);
+  TT.linein = 0;
   if (TT.tempname) replace_tempfile(TT.filein, TT.fileout, &TT.tempname);
   TT.fileout = TT.filein = -1;
 }
@@ -104,6 +108,8 @@ static void fail_hunk(void)
   TT.state = 2;
   llist_traverse(TT.current_hunk, do_line);
   TT.current_hunk = NULL;
+  linebuf_free(TT.linein);
+  TT.linein = 0;
   delete_tempfile(TT.filein, TT.fileout, &TT.tempname);
   TT.state = 0;
 }
@@ -154,7 +160,9 @@ static int apply_one_hunk(void)
   plist = TT.current_hunk;
   buf = NULL;
   if (TT.context) for (;;) {
-    char *data = get_line(TT.filein);
+    char *data = linebuf_line(TT.linein);
+
+    if (data) data = xstrdup(data);
 
     TT.linenum++;
 
@@ -257,14 +265,16 @@ void patch_main(void)
   char *oldname = NULL, *newname = NULL;
 
   if (TT.infile) TT.filepatch = xopen(TT.infile, O_RDONLY);
+  TT.linepatch = linebuf_new(TT.filepatch);
   TT.filein = TT.fileout = -1;
 
   // Loop through the lines in the patch
   for (;;) {
     char *patchline;
 
-    patchline = get_line(TT.filepatch);
+    patchline = linebuf_line(TT.linepatch);
     if (!patchline) break;
+    patchline = xstrdup(patchline);
 
     // Other versions of patch accept damaged patches,
     // so we need to also.
@@ -393,6 +403,7 @@ void patch_main(void)
             printf("patching %s\n", name);
             TT.filein = xopen(name, O_RDONLY);
           }
+          TT.linein = linebuf_new(TT.filein);
           TT.fileout = copy_tempfile(TT.filein, name, &TT.tempname);
           TT.linenum = 0;
           TT.hunknum = 0;
@@ -411,6 +422,7 @@ void patch_main(void)
   finish_oldfile();
 
   if (CFG_TOYBOX_FREE) {
+    linebuf_free(TT.linepatch);
     close(TT.filepatch);
     free(oldname);
     free(newname);
@@ -172,9 +172,9 @@ GLOBALS(
   // processed pattern list
   struct double_list *pattern;
 
-  char *nextline, *remember;
+  char *nextline, *remember, *obuf, *spare;
   void *restart, *lastregex;
-  long nextlen, rememberlen, count;
+  long nextlen, rememberlen, count, olen, sparelen;
   int fdout, noeol;
   unsigned xx;
 )
@@ -189,18 +189,13 @@ struct step {
   char c; // action
 };
 
-// Write out line with potential embedded NUL, handling eol/noeol
-static int emit(char *line, long len, int eol)
+// Write out pending output
+static int flush_out(void)
 {
-  int l, old = line[len];
-
-  if (TT.noeol && !writeall(TT.fdout, "\n", 1)) return 1;
-  if (eol) line[len++] = '\n';
-  if (!len) return 0;
-  TT.noeol = len && !eol;
-  l = writeall(TT.fdout, line, len);
-  if (eol) line[len-1] = old;
-  if (l != len) {
+  long len = TT.olen;
+
+  TT.olen = 0;
+  if (len && writeall(TT.fdout, TT.obuf, len) != len) {
     perror_msg("short write");
 
     return 1;
@@ -209,10 +204,42 @@ static int emit(char *line, long len, int eol)
   return 0;
 }
 
+// Don't lose output already produced when we error_exit() partway through.
+static void flush_exit(void)
+{
+  flush_out();
+}
+
+// Queue output, writing it out when the buffer fills
+static int out(char *s, long len)
+{
+  if (TT.olen+len > 65536 && flush_out()) return 1;
+  if (len >= 65536) {
+    if (writeall(TT.fdout, s, len) == len) return 0;
+    perror_msg("short write");
+
+    return 1;
+  }
+  memcpy(TT.obuf+TT.olen, s, len);
+  TT.olen += len;
+
+  return 0;
+}
+
+// Write out line with potential embedded NUL, handling eol/noeol
+static int emit(char *line, long len, int eol)
+{
+  if (TT.noeol && out("\n", 1)) return 1;
+  if (!len && !eol) return 0;
+  TT.noeol = !eol;
+
+  return out(line, len) || (eol && out("\n", 1));
+}
+
 // Do regex matching handling embedded NUL bytes in string. Note that
 // neither the pattern nor the match can currently include NUL bytes
 // (even with wildcards) and string must be null terminated.
-static int ghostwheel(regex_t *preg, char *string, long len, int nmatch,
+static int ghostwheel(struct regdfa *preg, char *string, long len, int nmatch,
   regmatch_t pmatch[], int eflags)
 {
   char *s = string;
@@ -227,7 +254,7 @@ static int ghostwheel(regex_t *preg, char *string, long len, int nmatch,
     }
     while (s[ll] && ll<len) ll++;
 
-    rc = regexec(preg, s, nmatch, pmatch, eflags);
+    rc = regdfa_exec(preg, s, nmatch, pmatch, eflags);
     if (!rc) {
       for (rc = 0; rc<nmatch && pmatch[rc].rm_so!=-1; rc++) {
         pmatch[rc].rm_so += s-string;
@@ -486,11 +513,19 @@ static void walk_pattern(char **pline, long plen)
     } else if (c=='s') {
       char *rline = line, *new = logrus->arg2 + (char *)logrus, *swap, *rswap;
       regmatch_t *match = (void *)toybuf;
-      regex_t *reg = get_regex(logrus, logrus->arg1);
-      int mflags = 0, count = 0, zmatch = 1, rlen = len, mlen, off, newlen;
+      struct regdfa *reg = get_regex(logrus, logrus->arg1);
+      int mflags = 0, count = 0, zmatch = 1, rlen = len, mlen, off, newlen,
+        nmatch = reg->prog ? 1 : 10;
+
+      // Only ask for subexpressions when the replacement uses them, so the
+      // DFA can answer without falling back to libc's backtracking matcher.
+      // (libc itself can give different answers for different nmatch.)
+      for (off = 0; new[off]; off++)
+        if (new[off] == '\\' && (unsigned)(new[++off]-'0')<10) nmatch = 10;
+        else if (!new[off]) break;
 
       // Find match in remaining line (up to remaining len)
-      while (!ghostwheel(reg, rline, rlen, 10, match, mflags)) {
+      while (!ghostwheel(reg, rline, rlen, nmatch, match, mflags)) {
         mflags = REG_NOTBOL;
 
         // Zero length matches don't count immediately after a previous match
@@ -579,6 +614,7 @@ static void walk_pattern(char **pline, long plen)
 
 writenow:
       // Swap out emit() context
+      flush_out();
       fd = TT.fdout;
       noeol = TT.noeol;
 
@@ -589,7 +625,7 @@ writenow:
       TT.noeol = *(name++);
 
       // write, then save/restore context
-      if (emit(line, len, eol))
+      if (emit(line, len, eol) || flush_out())
         perror_exit("w '%s'", logrus->arg1+(char *)logrus);
       *(--name) = TT.noeol;
       TT.noeol = noeol;
@@ -624,7 +660,12 @@ writenow:
   if (line && !(toys.optflags & FLAG_n)) emit(line, len, eol);
 
 done:
-  free(line);
+  // Keep the buffer to read the next line into
+  if (line) {
+    free(TT.spare);
+    TT.spare = line;
+    TT.sparelen = len+1;
+  }
 
   if (dlist_terminate(append)) while (append) {
     struct append *a = append->next;
@@ -634,8 +675,9 @@ done:
 
       // Force newline if noeol pending
       if (fd != -1) {
-        if (TT.noeol) xwrite(TT.fdout, "\n", 1);
+        if (TT.noeol) out("\n", 1);
         TT.noeol = 0;
+        flush_out();
         xsendfile(fd, TT.fdout);
         close(fd);
       }
@@ -645,28 +687,38 @@ done:
   }
 }
 
-// Genericish function, can probably get moved to lib.c
-
 // Iterate over lines in file, calling function. Function can write 0 to
 // the line pointer if they want to keep it, or 1 to terminate processing,
-// otherwise line is freed. Passed file descriptor is closed at the end.
+// otherwise the line's buffer is reused for the next one. Passed file
+// descriptor is closed at the end.
 static void do_lines(int fd, char *name, void (*call)(char **pline, long len))
 {
-  FILE *fp = fd ? xfdopen(fd, "r") : stdin;
+  struct linebuf *lb = linebuf_new(fd);
+  char *line = 0, *s;
+  long len, size = 0;
 
   for (;;) {
-    char *line = 0;
-    ssize_t len;
+    // Don't sit on output while waiting for a pipe or tty to give us more.
+    if (!(lb->flags & LINEBUF_SEEKABLE) && !linebuf_pending(lb, '\n'))
+      flush_out();
+    if (!(s = linebuf_raw(lb, &len, '\n'))) break;
 
-    len = getline(&line, (void *)&len, fp);
-    if (len > 0) {
-      call(&line, len);
-      if (line == (void *)1) break;
-      free(line);
-    } else break;
+    // Copy it out so the callback can keep it, recycling the last buffer.
+    if (!line) {
+      line = TT.spare;
+      size = TT.sparelen;
+      TT.spare = 0;
+      TT.sparelen = 0;
+    }
+    if (size <= len) line = xrealloc(line, size = len+1);
+    memcpy(line, s, len+1);
+    call(&line, len);
+    if (line == (void *)1) break;
   }
+  if (line != (void *)1) free(line);
+  linebuf_free(lb);
 
-  if (fd) fclose(fp);
+  if (fd) close(fd);
 }
 
 static void do_sed(int fd, char *name)
@@ -688,7 +740,9 @@ static void do_sed(int fd, char *name)
   }
   do_lines(fd, name, walk_pattern);
   if (i) {
+    // Output went out in big sequential writes, so one fsync() covers it.
     walk_pattern(0, 0);
+    if (flush_out() || fsync(TT.fdout)) perror_exit("%s", tmp);
     replace_tempfile(-1, TT.fdout, &tmp);
     TT.fdout = 1;
     TT.nextline = 0;
@@ -804,9 +858,9 @@ static void jewel_of_judgement(char **pline, long len)
         if (!(s = unescape_delimited_string(&line, 0, 1))) goto brand;
         if (!*s) corwin->rmatch[i] = 0;
         else {
-          xregcomp((void *)reg, s, (toys.optflags & FLAG_r)*REG_EXTENDED);
+          xregdfa((void *)reg, s, (toys.optflags & FLAG_r)*REG_EXTENDED);
           corwin->rmatch[i] = reg-toybuf;
-          reg += sizeof(regex_t);
+          reg += sizeof(struct regdfa);
         }
         free(s);
       } else break;
@@ -847,7 +901,7 @@ static void jewel_of_judgement(char **pline, long len)
       if (!(TT.remember = unescape_delimited_string(&line, &delim, 1)))
         goto brand;
 
-      reg += sizeof(regex_t);
+      reg += sizeof(struct regdfa);
       corwin->arg1 = reg-(char *)corwin;
       corwin->hit = delim;
 resume_s:
@@ -897,7 +951,7 @@ resume_s:
       // We deferred actually parsing the regex until we had the s///i flag
       // allocating the space was done by extend_string() above
       if (!*TT.remember) corwin->arg1 = 0;
-      else xregcomp((void *)(corwin->arg1 + (char *)corwin), TT.remember,
+      else xregdfa((void *)(corwin->arg1 + (char *)corwin), TT.remember,
         ((toys.optflags & FLAG_r)*REG_EXTENDED)|((corwin->sflags&1)*REG_ICASE));
       free(TT.remember);
       TT.remember = 0;
@@ -1038,11 +1092,14 @@ void sed_main(void)
 
   TT.fdout = 1;
   TT.remember = xstrdup("");
+  TT.obuf = xmalloc(65536);
+  atexit(flush_exit);
 
   // Inflict pattern upon input files
   loopfiles_rw(args, O_RDONLY, 0, 0, do_sed);
 
   if (!(toys.optflags & FLAG_i)) walk_pattern(0, 0);
+  flush_out();
 
   // todo: need to close fd when done for TOYBOX_FREE?
 }
@@ -4,7 +4,7 @@
  *
  * See http://opengroup.org/onlinepubs/007904975/utilities/sort.html
 
-USE_SORT(NEWTOY(sort, USE_SORT_FLOAT("g")USE_SORT_BIG("S:T:m" "o:k*t:xbMcszdfi") "run", TOYFLAG_USR|TOYFLAG_BIN))
+USE_SORT(NEWTOY(sort, USE_SORT_PARALLEL("(parallel)#<1")USE_SORT_FLOAT("g")USE_SORT_BIG("S:T:m" "o:k*t:xbMcszdfi") "run", TOYFLAG_USR|TOYFLAG_BIN))
 
 config SORT
   bool "sort"
@@ -23,7 +23,7 @@ config SORT_BIG
   default y
   depends on SORT
   help
-    usage: sort [-bcdfiMsz] [-k#[,#[x]] [-t X]] [-o FILE]
+    usage: sort [-bcdfimMsz] [-k#[,#[x]] [-t X]] [-o FILE] [-S SIZE] [-T DIR]
 
     -b	ignore leading blanks (or trailing blanks in second part of key)
     -c	check whether input is sorted
@@ -37,6 +37,10 @@ config SORT_BIG
     -k	sort by "key" (see below)
     -t	use a key separator other than whitespace
     -o	output to FILE instead of stdout
+    -m	merge already sorted files (without sorting them)
+    -S	memory to use before sorting in chunks via temp files
+    	(default half of RAM; K=1024 is the default unit, M, G, or % of RAM)
+    -T	directory for temporary files (default $TMPDIR or /tmp)
 
     Sorting by key looks at a subset of the words on each line.  -k2
     uses the second word to the end of the line, -k2,2 looks at only
@@ -53,6 +57,15 @@ config SORT_FLOAT
     usage: sort [-g]
 
     -g	general numeric sort (double precision with nan and inf)
+
+config SORT_PARALLEL
+  bool
+  default y
+  depends on SORT_BIG && TOYBOX_THREADS
+  help
+    usage: sort [--parallel=N]
+
+    --parallel=N  sort with N threads
 */
 
 #define FOR_sort
@@ -62,11 +75,19 @@ GLOBALS(
   char *key_separator;
   struct arg_list *raw_keys;
   char *outfile;
-  char *ignore1, ignore2;   // GNU compatability NOPs for -S and -T.
+  char *tmpdir;
+  char *size;
+  long parallel;
 
   void *key_list;
-  int linecount;
-  char **lines;
+  int linecount, linemax, keycount, plain;
+  struct sort_rec **lines;
+  char *slabs, *slabpos, *slabend;
+  long long mem, limit;
+  int *runs, runcount, olen, ofd;
+  dev_t odev;
+  ino_t oino;
+  char *tempname;
 )
 
 // The sort types are n, g, and M.
@@ -83,20 +104,34 @@ struct sort_key
   int flags;
 };
 
-// Copy of the part of this string corresponding to a key/flags.
+// One key of one line, extracted by sort_decorate() so comparisons don't
+// have to find, copy or parse it again.
+struct sort_val
+{
+  char *str;        // key text (not null terminated)
+  unsigned len;
+  int type;         // -g: 0 not a number, 1 NaN, 2 number
+  double d;         // -n, -g
+  long long ll;     // -M, -x, integer -n
+};
 
-static char *get_key_data(char *str, struct sort_key *key, int flags)
+struct sort_rec
 {
-  int start=0, end, len, i, j;
+  char *line;
+  unsigned len;
+  struct sort_val val[];
+};
 
-  // Special case whole string, so we don't have to make a copy
+// Find the part of this string corresponding to a key/flags, returning its
+// start and setting *plen to its length.
 
-  if(key->range[0]==1 && !key->range[1] && !key->range[2] && !key->range[3]
-    && !(flags&(FLAG_b&FLAG_d&FLAG_f&FLAG_i&FLAG_bb))) return str;
+static char *get_key_data(char *str, long len, struct sort_key *key, int flags,
+  long *plen)
+{
+  int start=0, end, i, j;
 
   // Find start of key on first pass, end on second pass
 
-  len = strlen(str);
   for (j=0; j<2; j++) {
     if (!key->range[2*j]) end=len;
 
@@ -136,29 +171,10 @@ static char *get_key_data(char *str, struct sort_key *key, int flags)
     start += key->range[1]-1;
     if (start>len) start=len;
   }
-
-  // Make the copy
   if (end<start) end=start;
-  str = xstrndup(str+start, end-start);
+  *plen = end-start;
 
-  // Handle -d
-  if (flags&FLAG_d) {
-    for (start = end = 0; str[end]; end++)
-      if (isspace(str[end]) || isalnum(str[end])) str[start++] = str[end];
-    str[start] = 0;
-  }
-
-  // Handle -i
-  if (flags&FLAG_i) {
-    for (start = end = 0; str[end]; end++)
-      if (isprint(str[end])) str[start++] = str[end];
-    str[start] = 0;
-  }
-
-  // Handle -f
-  if (flags*FLAG_f) for(i=0; str[i]; i++) str[i] = toupper(str[i]);
-
-  return str;
+  return str+start;
 }
 
 // append a sort_key to key_list.
@@ -169,113 +185,609 @@ static struct sort_key *add_key(void)
   struct sort_key **pkey = (struct sort_key **)stupid_compiler;
 
   while (*pkey) pkey = &((*pkey)->next_key);
+  TT.keycount++;
   return *pkey = xzalloc(sizeof(struct sort_key));
 }
 
-// Perform actual comparison
-static int compare_values(int flags, char *x, char *y)
+// Parse numeric key types once up front. Type orders -g keys: not numbers
+// < NaN < numbers (including infinities). NaN from -n sorts the same way
+// rather than comparing equal to everything.
+static void sort_number(struct sort_val *val, int flags)
 {
   int ff = flags & (FLAG_n|FLAG_g|FLAG_M|FLAG_x);
+  char buf[64], *s = buf, *ss;
 
-  // Ascii sort
-  if (!ff) return strcmp(x, y);
+  val->type = 2;
+  if (!ff) return;
+  if (val->len >= sizeof(buf)) s = xmalloc(val->len+1);
+  memcpy(s, val->str, val->len);
+  s[val->len] = 0;
 
   if (CFG_SORT_FLOAT && ff == FLAG_g) {
-    char *xx,*yy;
-    double dx = strtod(x,&xx), dy = strtod(y,&yy);
-    int xinf, yinf;
+    val->d = strtod(s, &ss);
+    if (s == ss) val->type = 0;
+    else if (val->d != val->d) val->type = 1;
+  } else if (CFG_SORT_BIG && ff == FLAG_M) {
+    struct tm thyme;
 
-    // not numbers < NaN < -infinity < numbers < +infinity
+    val->ll = strptime(s, "%b", &thyme) ? thyme.tm_mon : -1;
+  } else if (CFG_SORT_BIG && ff == FLAG_x) val->ll = strtoll(s, 0, 16);
+  // This has to be ff == FLAG_n: floating point, or integer for tiny systems
+  else if (CFG_SORT_FLOAT) {
+    val->d = atof(s);
+    if (val->d != val->d) val->type = 1;
+  } else val->ll = atoll(s);
 
-    if (x==xx) return y==yy ? 0 : -1;
-    if (y==yy) return 1;
+  if (s != buf) free(s);
+}
 
-    // Check for isnan
-    if (dx!=dx) return (dy!=dy) ? 0 : -1;
-    if (dy!=dy) return 1;
+// Carve memory for lines out of big slabs, so a lot of short lines don't each
+// pay for a malloc() header (and can all be freed at once). Each slab starts
+// with a pointer to the previous one.
+static void *sort_alloc(long size)
+{
+  size = (size+7)&~7;
+  if (TT.slabend-TT.slabpos < size) {
+    long len = size+sizeof(char *) > 1<<20 ? size+sizeof(char *) : 1<<20;
+    char *slab = xmalloc(len);
+
+    *(char **)slab = TT.slabs;
+    TT.slabs = slab;
+    TT.slabpos = slab+sizeof(char *);
+    TT.slabend = slab+len;
+  }
+  TT.slabpos += size;
 
-    // Check for infinity.  (Could underflow, but avoids needing libm.)
-    xinf = (1.0/dx == 0.0);
-    yinf = (1.0/dy == 0.0);
-    if (xinf) {
-      if(dx<0) return (yinf && dy<0) ? 0 : -1;
-      return (yinf && dy>0) ? 0 : 1;
-    }
-    if (yinf) return dy<0 ? 1 : -1;
+  return TT.slabpos-size;
+}
 
-    return dx>dy ? 1 : (dx<dy ? -1 : 0);
-  } else if (CFG_SORT_BIG && ff == FLAG_M) {
-    struct tm thyme;
-    int dx;
-    char *xx,*yy;
-
-    xx = strptime(x,"%b",&thyme);
-    dx = thyme.tm_mon;
-    yy = strptime(y,"%b",&thyme);
-    if (!xx) return !yy ? 0 : -1;
-    else if (!yy) return 1;
-    else return dx==thyme.tm_mon ? 0 : dx-thyme.tm_mon;
-
-  } else if (CFG_SORT_BIG && ff == FLAG_x) {
-    return strtol(x, NULL, 16)-strtol(y, NULL, 16);
-  // This has to be ff == FLAG_n
-  } else {
-    // Full floating point version of -n
-    if (CFG_SORT_FLOAT) {
-      double dx = atof(x), dy = atof(y);
+static void sort_free_slabs(void)
+{
+  char *next;
 
-      return dx>dy ? 1 : (dx<dy ? -1 : 0);
-    // Integer version of -n for tiny systems
-    } else return atoi(x)-atoi(y);
+  for (; TT.slabs; TT.slabs = next) {
+    next = *(char **)TT.slabs;
+    free(TT.slabs);
   }
+  TT.slabpos = TT.slabend = 0;
 }
 
-// Callback from qsort(): Iterate through key_list and perform comparisons.
-static int compare_keys(const void *xarg, const void *yarg)
+// Extract each key from a line into one allocation (from the slabs, or
+// malloc() if !slab): the sort_rec, its sort_val array, a copy of the line,
+// then copies of keys -d, -i or -f rewrote. Other keys point into the line.
+static struct sort_rec *sort_decorate(char *line, int slab)
 {
-  int flags = toys.optflags, retval = 0;
-  char *x, *y, *xx = *(char **)xarg, *yy = *(char **)yarg;
   struct sort_key *key;
+  struct sort_rec *rec;
+  long len = strlen(line), size = len+1, klen, i, j;
+  char *arena, *s;
+  int flags;
 
-  if (CFG_SORT_BIG) {
-    for (key=(struct sort_key *)TT.key_list; !retval && key;
-       key = key->next_key)
-    {
-      flags = key->flags ? key->flags : toys.optflags;
+  for (key = TT.key_list; key; key = key->next_key) {
+    flags = key->flags ? key->flags : toys.optflags;
+    if (flags&(FLAG_d|FLAG_i|FLAG_f)) size += len;
+  }
+  size += sizeof(struct sort_rec)+TT.keycount*sizeof(struct sort_val);
+  TT.mem += size;
+  rec = slab ? sort_alloc(size) : xmalloc(size);
+  arena = (char *)(rec->val+TT.keycount);
+  rec->line = memcpy(arena, line, len+1);
+  rec->len = len;
+  arena += len+1;
+
+  for (i = 0, key = TT.key_list; key; key = key->next_key, i++) {
+    struct sort_val *val = rec->val+i;
+
+    flags = key->flags ? key->flags : toys.optflags;
+    val->str = get_key_data(rec->line, len, key, flags, &klen);
+    if (flags&(FLAG_d|FLAG_i|FLAG_f)) {
+      for (s = arena, j = 0; j<klen; j++) {
+        char c = val->str[j];
+
+        if ((flags&FLAG_d) && !isspace(c) && !isalnum(c)) continue;
+        if ((flags&FLAG_i) && !isprint(c)) continue;
+        *s++ = (flags&FLAG_f) ? toupper(c) : c;
+      }
+      val->str = arena;
+      klen = s-arena;
+      arena = s;
+    }
+    val->len = klen;
+    val->d = val->ll = 0;
+    sort_number(val, flags);
+  }
+
+  return rec;
+}
 
-      // Chop out and modify key chunks, handling -dfib
+// Perform actual comparison
+static int compare_values(int flags, struct sort_val *x, struct sort_val *y)
+{
+  int ret;
 
-      x = get_key_data(xx, key, flags);
-      y = get_key_data(yy, key, flags);
+  // Ascii sort
+  if (!(flags & (FLAG_n|FLAG_g|FLAG_M|FLAG_x))) {
+    ret = memcmp(x->str, y->str, x->len<y->len ? x->len : y->len);
 
-      retval = compare_values(flags, x, y);
+    return ret ? ret : (x->len>y->len)-(x->len<y->len);
+  }
 
-      // Free the copies get_key_data() made.
+  // Numeric types: whichever of d and ll sort_number() didn't set is 0.
+  if (x->type != y->type) return x->type<y->type ? -1 : 1;
+  if (x->type == 2 && x->d != y->d) return x->d<y->d ? -1 : 1;
 
-      if (x != xx) free(x);
-      if (y != yy) free(y);
+  return (x->ll>y->ll)-(x->ll<y->ll);
+}
 
-      if (retval) break;
-    }
-  } else retval = compare_values(flags, xx, yy);
+// Callback from qsort(): Iterate through key_list and perform comparisons.
+static int compare_keys(const void *xarg, const void *yarg)
+{
+  struct sort_rec *x = *(struct sort_rec **)xarg, *y = *(struct sort_rec **)yarg;
+  struct sort_key *key;
+  int flags = toys.optflags, retval = 0, i;
+
+  for (i = 0, key = TT.key_list; key; key = key->next_key, i++) {
+    flags = key->flags ? key->flags : toys.optflags;
+    if ((retval = compare_values(flags, x->val+i, y->val+i))) break;
+  }
 
   // Perform fallback sort if necessary
   if (!retval && !(CFG_SORT_BIG && (toys.optflags&FLAG_s))) {
-    retval = strcmp(xx, yy);
+    retval = strcmp(x->line, y->line);
     flags = toys.optflags;
   }
 
   return retval * ((flags&FLAG_r) ? -1 : 1);
 }
 
+// Buffered output of one line (with terminator) through toybuf, flushed
+// when full or when s is NULL.
+static void sort_write(int fd, char *s)
+{
+  unsigned len;
+
+  if (!s || TT.olen+(len = strlen(s)+1) > sizeof(toybuf)) {
+    xwrite(fd, toybuf, TT.olen);
+    TT.olen = 0;
+  }
+  if (!s) return;
+  if (len > sizeof(toybuf)) {
+    s[len-1] = (toys.optflags&FLAG_z) ? 0 : '\n';
+    xwrite(fd, s, len);
+    s[len-1] = 0;
+  } else {
+    memcpy(toybuf+TT.olen, s, len);
+    TT.olen += len;
+    if (!(toys.optflags&FLAG_z)) toybuf[TT.olen-1] = '\n';
+  }
+}
+
+static struct sort_rec *sort_line(struct linebuf *lb, int slab)
+{
+  char *line = (CFG_SORT_BIG && (toys.optflags&FLAG_z))
+    ? linebuf_raw(lb, NULL, 0) : linebuf_line(lb);
+
+  return line ? sort_decorate(line, slab) : 0;
+}
+
+// Plain byte order sorts (no keys or flags changing comparison) use an MSD
+// radix sort over an array of line pointers each next to a cache of the 8
+// bytes at the current depth, so most steps never touch the line itself.
+
+struct sort_pre {
+  unsigned long long pre;
+  struct sort_rec *rec;
+};
+
+// Next 8 bytes of string (big endian, so integer order is byte order),
+// zero padded after the end.
+static unsigned long long sort_prefix(char *s)
+{
+  unsigned long long pre = 0;
+  int i;
+
+  for (i = 0; i<8 && s[i]; i++)
+    pre |= (unsigned long long)(unsigned char)s[i]<<(56-8*i);
+
+  return pre;
+}
+
+// Compare sort_pres with prefixes cached at the same depth (so everything
+// before that matched).
+static int sort_precmp(const void *aa, const void *bb)
+{
+  const struct sort_pre *a = aa, *b = bb;
+
+  if (a->pre != b->pre) return a->pre<b->pre ? -1 : 1;
+  if (!(a->pre&255)) return 0;
+
+  return strcmp(a->rec->line, b->rec->line);
+}
+
+// Sort a[n] on byte "byte" of the prefixes cached for string offset depth,
+// via tmp[n]. Small or deep cases (a lot of lines with long common prefixes)
+// finish with qsort().
+static void sort_msd(struct sort_pre *a, struct sort_pre *tmp, long n,
+  long depth, int byte, int level)
+{
+  long count[256], start[256], i, pos;
+  int shift, c;
+
+  for (;;) {
+    if (n<32 || level>64) {
+      qsort(a, n, sizeof(*a), sort_precmp);
+
+      return;
+    }
+
+    // Used up the cached bytes: load the next 8.
+    if (byte == 8) {
+      depth += 8;
+      byte = 0;
+      for (i = 0; i<n; i++) a[i].pre = sort_prefix(a[i].rec->line+depth);
+    }
+    shift = 56-8*byte;
+    memset(count, 0, sizeof(count));
+    for (i = 0; i<n; i++) count[(a[i].pre>>shift)&255]++;
+
+    // All the same byte here: move on to the next without recursing, or stop
+    // if it's the end of them all.
+    c = (a->pre>>shift)&255;
+    if (count[c] != n) break;
+    if (!c) return;
+    byte++;
+  }
+
+  for (pos = i = 0; i<256; i++) {
+    start[i] = pos;
+    pos += count[i];
+  }
+  for (i = 0; i<n; i++) tmp[start[(a[i].pre>>shift)&255]++] = a[i];
+  memcpy(a, tmp, n*sizeof(*a));
+
+  // Bucket 0 is lines that ended, which are all equal.
+  for (i = 1; i<256; i++) if (count[i]) {
+    pos = start[i]-count[i];
+    sort_msd(a+pos, tmp+pos, count[i], depth, byte+1, level+1);
+  }
+}
+
+// Merge sort for -s, since qsort() doesn't promise to keep equal lines in
+// input order. tmp has room for n/2 lines.
+static void sort_stable(struct sort_rec **a, struct sort_rec **tmp, long n)
+{
+  long i, j, k, half = n/2;
+
+  if (n<2) return;
+  sort_stable(a, tmp, half);
+  sort_stable(a+half, tmp, n-half);
+  memcpy(tmp, a, half*sizeof(*a));
+  for (i = k = 0, j = half; i<half;)
+    a[k++] = (j==n || compare_keys(tmp+i, a+j)<=0) ? tmp[i++] : a[j++];
+}
+
+// Sort an array of lines, by radix for plain byte order or else qsort().
+static void sort_array(struct sort_rec **lines, long n)
+{
+  struct sort_pre *pre;
+  long i;
+
+  if (!TT.plain || n<64) {
+    if (CFG_SORT_BIG && (toys.optflags&FLAG_s)) {
+      struct sort_rec **tmp = xmalloc((n/2+1)*sizeof(*tmp));
+
+      sort_stable(lines, tmp, n);
+      free(tmp);
+    } else qsort(lines, n, sizeof(*lines), compare_keys);
+
+    return;
+  }
+  pre = xmalloc(2*n*sizeof(*pre));
+  for (i = 0; i<n; i++) {
+    pre[i].rec = lines[i];
+    pre[i].pre = sort_prefix(lines[i]->line);
+  }
+  sort_msd(pre, pre+n, n, 0, 0, 0);
+  for (i = 0; i<n; i++)
+    lines[(toys.optflags&FLAG_r) ? n-1-i : i] = pre[i].rec;
+  free(pre);
+}
+
+// --parallel work unit: qsort() a[alen] when out is NULL, else merge the
+// part of a[alen] and b[blen] that lands in out[start] to out[end].
+struct sort_job {
+  struct sort_rec **a, **b, **out;
+  long alen, blen, start, end;
+};
+
+// How many of the first k merged lines come from a. Ties go to a, so merging
+// stays stable.
+static long sort_corank(struct sort_job *job, long k)
+{
+  long lo = k>job->blen ? k-job->blen : 0, hi = k<job->alen ? k : job->alen,
+    i, j;
+
+  for (;;) {
+    j = k-(i = (lo+hi)/2);
+    if (i && j<job->blen && compare_keys(job->a+i-1, job->b+j)>0) hi = i-1;
+    else if (j && i<job->alen && compare_keys(job->b+j-1, job->a+i)>=0)
+      lo = i+1;
+    else return i;
+  }
+}
+
+static void *sort_job(void *arg)
+{
+  struct sort_job *job = arg;
+  long i, j, iend, jend, k;
+
+  if (!job->out) {
+    sort_array(job->a, job->alen);
+
+    return 0;
+  }
+  i = sort_corank(job, job->start);
+  iend = sort_corank(job, job->end);
+  j = job->start-i;
+  jend = job->end-iend;
+  for (k = job->start; k<job->end;) {
+    if (j==jend || (i<iend && compare_keys(job->a+i, job->b+j)<=0))
+      job->out[k++] = job->a[i++];
+    else job->out[k++] = job->b[j++];
+  }
+
+  return 0;
+}
+
+// Run jobs in threads, the last one (and any we can't start) in this thread.
+static void sort_threads(struct sort_job *jobs, int count)
+{
+  pthread_t *tids = xmalloc(count*sizeof(pthread_t));
+  int i, j;
+
+  for (i = 0; i<count-1; i++)
+    if (pthread_create(tids+i, 0, sort_job, jobs+i)) break;
+  for (j = i; j<count; j++) sort_job(jobs+j);
+  while (i--) pthread_join(tids[i], 0);
+  free(tids);
+}
+
+// qsort() TT.lines in --parallel chunks, then merge pairs of chunks with all
+// threads splitting each merge between them, until one sorted array is left.
+static void sort_parallel(int threads)
+{
+  struct sort_job *jobs = xzalloc(threads*sizeof(*jobs));
+  struct sort_rec **from = TT.lines, **ss,
+    **to = xmalloc(TT.linecount*sizeof(*to));
+  long *edge = xmalloc((threads+1)*sizeof(long)), i;
+  int chunks = threads, pairs, per, njobs, j, k;
+
+  for (i = 0; i<=chunks; i++) edge[i] = TT.linecount*i/chunks;
+  for (i = 0; i<chunks; i++) {
+    jobs[i].a = from+edge[i];
+    jobs[i].alen = edge[i+1]-edge[i];
+  }
+  sort_threads(jobs, chunks);
+
+  while (chunks>1) {
+    pairs = chunks/2;
+    per = threads/pairs ? threads/pairs : 1;
+    for (njobs = j = 0; j<pairs; j++) {
+      long a = edge[2*j], b = edge[2*j+1], c = edge[2*j+2];
+
+      for (k = 0; k<per; k++, njobs++) {
+        jobs[njobs].a = from+a;
+        jobs[njobs].alen = b-a;
+        jobs[njobs].b = from+b;
+        jobs[njobs].blen = c-b;
+        jobs[njobs].out = to+a;
+        jobs[njobs].start = (c-a)*k/per;
+        jobs[njobs].end = (c-a)*(k+1)/per;
+      }
+    }
+    sort_threads(jobs, njobs);
+
+    // Odd chunk out just gets copied
+    if (chunks&1) memcpy(to+edge[chunks-1], from+edge[chunks-1],
+      (edge[chunks]-edge[chunks-1])*sizeof(*to));
+    for (j = 0; j<=pairs; j++) edge[j] = edge[2*j];
+    if (chunks&1) edge[++pairs] = TT.linecount;
+    chunks = pairs;
+    ss = from;
+    from = to;
+    to = ss;
+  }
+  free(to);
+  TT.lines = from;
+  TT.linemax = TT.linecount;
+  free(edge);
+  free(jobs);
+}
+
+// Sort TT.lines and handle unique (-u)
+static void sort_lines(void)
+{
+  int idx, jdx, threads = TT.parallel;
+
+  // Threads only pay off with a decent amount of work each.
+  if (threads > TT.linecount/4096) threads = TT.linecount/4096;
+  if (CFG_TOYBOX_THREADS && threads>1) sort_parallel(threads);
+  else sort_array(TT.lines, TT.linecount);
+
+  if (toys.optflags&FLAG_u) {
+    for (jdx=0, idx=1; idx<TT.linecount; idx++) {
+      if (compare_keys(&TT.lines[jdx], &TT.lines[idx]))
+        TT.lines[++jdx] = TT.lines[idx];
+    }
+    if (TT.linecount) TT.linecount = jdx+1;
+  }
+}
+
+// Write out (and maybe free) TT.lines, straight from the slabs with one
+// writev() per batch of lines.
+static void sort_output(int fd, int freeit)
+{
+  struct iovec iov[1024];
+  int idx, i = 0, j;
+  ssize_t len;
+
+  for (idx = 0; idx<TT.linecount || i; idx++) {
+    if (idx<TT.linecount) {
+      struct sort_rec *rec = TT.lines[idx];
+
+      // Done comparing, so the terminator can become the newline.
+      if (!(toys.optflags&FLAG_z)) rec->line[rec->len] = '\n';
+      iov[i].iov_base = rec->line;
+      iov[i++].iov_len = rec->len+1;
+      if (i<ARRAY_LEN(iov)) continue;
+    }
+
+    // Retry after short writes
+    for (j = 0; j<i;) {
+      if (0>(len = writev(fd, iov+j, i-j))) {
+        if (errno == EINTR) continue;
+        perror_exit("xwrite");
+      }
+      if (CFG_TOYBOX_STATS) {
+        TOYSTAT(writes, 1);
+        TOYSTAT(wbytes, len);
+      }
+      for (; j<i && len >= iov[j].iov_len; j++) len -= iov[j].iov_len;
+      if (len) {
+        iov[j].iov_base = (char *)iov[j].iov_base+len;
+        iov[j].iov_len -= len;
+      }
+    }
+    i = 0;
+  }
+  if (freeit) sort_free_slabs();
+  TT.linecount = TT.mem = 0;
+}
+
+// Unlinked temp file under -T, $TMPDIR or /tmp
+static int sort_temp(void)
+{
+  char *dir = TT.tmpdir ? TT.tmpdir : getenv("TMPDIR"),
+       *name = xmprintf("%s/sortXXXXXX", (dir && *dir) ? dir : "/tmp");
+  int fd = mkstemp(name);
+
+  if (fd == -1) perror_exit("%s", name);
+  unlink(name);
+  free(name);
+
+  return fd;
+}
+
+// Sort the lines read so far into a temp file, freeing their memory.
+static void sort_spill(void)
+{
+  int fd = sort_temp();
+
+  sort_lines();
+  sort_output(fd, 1);
+  xlseek(fd, 0, SEEK_SET);
+  if (!(TT.runcount&15))
+    TT.runs = xrealloc(TT.runs, sizeof(int)*(TT.runcount+16));
+  TT.runs[TT.runcount++] = fd;
+}
+
+// Merge count already sorted fds to out with a heap, closing them.
+static void sort_merge(int *fds, int count, int out)
+{
+  struct sort_src {
+    struct linebuf *lb;
+    struct sort_rec *rec;
+    int idx;
+  } *src = xmalloc(count*sizeof(*src)), **heap = xmalloc(count*sizeof(*heap)),
+    *ss;
+  struct sort_rec *last = 0, *rec;
+  int i, j, k, len = 0;
+
+  for (i = 0; i<count; i++) {
+    src[i].lb = linebuf_new(fds[i]);
+    src[i].idx = i;
+    if ((src[i].rec = sort_line(src[i].lb, 0))) heap[len++] = src+i;
+    else {
+      linebuf_free(src[i].lb);
+      close(fds[i]);
+    }
+  }
+
+  // Heap order by line, ties go to earlier input to keep -s stable
+#define HEAPLESS(a, b) ((k = compare_keys(&(a)->rec, &(b)->rec)) < 0 \
+    || (!k && (a)->idx < (b)->idx))
+  for (i = len/2; i--;) for (j = i;;) {
+    int c = 2*j+1;
+
+    if (c>=len) break;
+    if (c+1<len && HEAPLESS(heap[c+1], heap[c])) c++;
+    if (!HEAPLESS(heap[c], heap[j])) break;
+    ss = heap[c];
+    heap[c] = heap[j];
+    heap[j] = ss;
+    j = c;
+  }
+
+  while (len) {
+    ss = *heap;
+    rec = ss->rec;
+    if (!(toys.optflags&FLAG_u) || !last || compare_keys(&last, &rec)) {
+      sort_write(out, rec->line);
+
+      // -u compares against the last line written
+      if (toys.optflags&FLAG_u) {
+        free(last);
+        last = rec;
+        rec = 0;
+      }
+    }
+    free(rec);
+    if (!(ss->rec = sort_line(ss->lb, 0))) {
+      linebuf_free(ss->lb);
+      close(fds[ss->idx]);
+      *heap = heap[--len];
+    }
+    for (j = 0;;) {
+      int c = 2*j+1;
+
+      if (c>=len) break;
+      if (c+1<len && HEAPLESS(heap[c+1], heap[c])) c++;
+      if (!HEAPLESS(heap[c], heap[j])) break;
+      ss = heap[c];
+      heap[c] = heap[j];
+      heap[j] = ss;
+      j = c;
+    }
+  }
+#undef HEAPLESS
+  sort_write(out, 0);
+  free(last);
+  free(heap);
+  free(src);
+}
+
+// Callback from loopfiles_rw() for -m: keep input open to merge later.
+static void sort_open(int fd, char *name)
+{
+  struct stat st;
+
+  // Note an input that is also the -o file, so we don't truncate it early
+  if (TT.outfile && !fstat(fd, &st) && st.st_dev == TT.odev
+    && st.st_ino == TT.oino) TT.ofd = fd;
+  if (!(TT.runcount&15))
+    TT.runs = xrealloc(TT.runs, sizeof(int)*(TT.runcount+16));
+  TT.runs[TT.runcount++] = fd;
+}
+
 // Callback from loopfiles to handle input files.
 static void sort_read(int fd, char *name)
 {
+  struct linebuf *lb = linebuf_new(fd);
+
   // Read each line from file, appending to a big array.
 
   for (;;) {
-    char * line = (CFG_SORT_BIG && (toys.optflags&FLAG_z))
-             ? get_rawline(fd, NULL, 0) : get_line(fd);
+    struct sort_rec *line = sort_line(lb, !(toys.optflags&FLAG_c));
 
     if (!line) break;
 
@@ -286,23 +798,50 @@ static void sort_read(int fd, char *name)
       if (TT.lines && compare_keys((void *)&TT.lines, &line)>j)
         error_exit("%s: Check line %d\n", name, TT.linecount);
       free(TT.lines);
-      TT.lines = (char **)line;
+      TT.lines = (void *)line;
     } else {
-      if (!(TT.linecount&63))
-        TT.lines = xrealloc(TT.lines, sizeof(char *)*(TT.linecount+64));
+      if (TT.linecount == TT.linemax)
+        TT.lines = xrealloc(TT.lines,
+          sizeof(*TT.lines)*(TT.linemax = TT.linemax*2+64));
       TT.lines[TT.linecount] = line;
+
+      // Past -S, sort what we have into a temp file
+      TT.mem += sizeof(*TT.lines);
+      if (CFG_SORT_BIG && TT.mem > TT.limit) {
+        TT.linecount++;
+        sort_spill();
+        continue;
+      }
     }
     TT.linecount++;
   }
+  linebuf_free(lb);
 }
 
 void sort_main(void)
 {
   int idx, fd = 1;
 
-  // Open output file if necessary.
-  if (CFG_SORT_BIG && TT.outfile)
-    fd = xcreate(TT.outfile, O_CREAT|O_TRUNC|O_WRONLY, 0666);
+  // Memory budget before spilling to temp files, see -S
+  TT.limit = LLONG_MAX;
+  if (CFG_SORT_BIG) {
+    struct sysinfo si;
+    long long ram = sysinfo(&si) ? 0 : (long long)si.totalram*si.mem_unit;
+
+    if (ram) TT.limit = ram/2;
+    if (TT.size && *TT.size) {
+      char *s = TT.size+strlen(TT.size)-1;
+
+      if (*s == '%') {
+        *s = 0;
+        TT.limit = ram/100*atolx_range(TT.size, 1, 100);
+      } else {
+        TT.limit = atolx(TT.size);
+        if (isdigit(*s)) TT.limit *= 1024;
+      }
+      if (TT.limit < 1) TT.limit = 1;
+    }
+  }
 
   // Parse -k sort keys.
   if (CFG_SORT_BIG && TT.raw_keys) {
@@ -335,7 +874,7 @@ void sort_main(void)
           // Which flag is this?
 
           optlist = toys.which->options;
-          temp2 = strchr(optlist, *temp);
+          temp2 = strrchr(optlist, *temp);
           flag = (1<<(optlist-temp2+strlen(optlist)-1));
 
           // Was it a flag that can apply to a key?
@@ -357,43 +896,76 @@ void sort_main(void)
   if (toys.optflags&FLAG_b) toys.optflags |= FLAG_bb;
 
   // If no keys, perform alphabetic sort over the whole line.
-  if (CFG_SORT_BIG && !TT.key_list) add_key()->range[0] = 1;
+  if (!TT.key_list) add_key()->range[0] = 1;
+
+  // Plain byte order (the whole line, nothing changing how it compares)?
+  if (TT.keycount == 1) {
+    struct sort_key *key = TT.key_list;
+
+    TT.plain = key->range[0]==1 && !key->range[1] && !key->range[2]
+      && !key->range[3] && !key->flags && !(toys.optflags
+        & (FLAG_n|FLAG_g|FLAG_M|FLAG_x|FLAG_f|FLAG_d|FLAG_i|FLAG_b));
+  }
+
+  // -m streams already sorted inputs through the merge, else open input
+  // files and read data, populating TT.lines[TT.linecount] and spilling
+  // sorted runs to temp files past the -S limit.
+  TT.ofd = -1;
+  if (CFG_SORT_BIG && (toys.optflags&FLAG_m) && !(toys.optflags&FLAG_c)) {
+    struct stat st;
 
-  // Open input files and read data, populating TT.lines[TT.linecount]
-  loopfiles(toys.optargs, sort_read);
+    if (TT.outfile && !stat(TT.outfile, &st)) {
+      TT.odev = st.st_dev;
+      TT.oino = st.st_ino;
+    }
+    loopfiles_rw(toys.optargs, O_RDONLY, 0, 0, sort_open);
+  } else loopfiles(toys.optargs, sort_read);
 
   // The compare (-c) logic was handled in sort_read(),
   // so if we got here, we're done.
   if (CFG_SORT_BIG && (toys.optflags&FLAG_c)) goto exit_now;
 
-  // Perform the actual sort
-  qsort(TT.lines, TT.linecount, sizeof(char *), compare_keys);
-
-  // handle unique (-u)
-  if (toys.optflags&FLAG_u) {
-    int jdx;
-
-    for (jdx=0, idx=1; idx<TT.linecount; idx++) {
-      if (!compare_keys(&TT.lines[jdx], &TT.lines[idx]))
-        free(TT.lines[idx]);
-      else TT.lines[++jdx] = TT.lines[idx];
-    }
-    if (TT.linecount) TT.linecount = jdx+1;
+  // Open output file if necessary (after reading, so sort -o can overwrite
+  // an input). -m is still reading its inputs, so write to a temp file
+  // and rename it over the input when done.
+  if (CFG_SORT_BIG && TT.outfile) {
+    if (TT.ofd != -1) fd = copy_tempfile(TT.ofd, TT.outfile, &TT.tempname);
+    else fd = xcreate(TT.outfile, O_CREAT|O_TRUNC|O_WRONLY, 0666);
   }
 
-  // Output result
-  for (idx = 0; idx<TT.linecount; idx++) {
-    char *s = TT.lines[idx];
-    unsigned i = strlen(s);
+  if (CFG_SORT_BIG && TT.runcount) {
+    if (TT.linecount) sort_spill();
 
-    if (!(toys.optflags&FLAG_z)) s[i] = '\n';
-    xwrite(fd, s, i+1);
-    if (CFG_TOYBOX_FREE) free(s);
+    // Merge 16 at a time into new temp files until one pass can finish,
+    // keeping runs in input order so -s stays stable.
+    while (TT.runcount > 16) {
+      int i, j, out;
+
+      for (i = j = 0; i<TT.runcount; i += 16) {
+        if (TT.runcount-i == 1) out = TT.runs[i];
+        else {
+          sort_merge(TT.runs+i, TT.runcount-i<16 ? TT.runcount-i : 16,
+            out = sort_temp());
+          xlseek(out, 0, SEEK_SET);
+        }
+        TT.runs[j++] = out;
+      }
+      TT.runcount = j;
+    }
+    sort_merge(TT.runs, TT.runcount, fd);
+    if (TT.tempname) {
+      replace_tempfile(-1, fd, &TT.tempname);
+      fd = 1;
+    }
+  } else {
+    sort_lines();
+    sort_output(fd, CFG_TOYBOX_FREE);
   }
 
 exit_now:
   if (CFG_TOYBOX_FREE) {
     if (fd != 1) close(fd);
     free(TT.lines);
+    free(TT.runs);
   }
 }
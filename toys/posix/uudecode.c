@@ -29,12 +29,13 @@ void uudecode_main(void)
   int ifd = 0, ofd, idx = 0, m = m;
   char *line = 0, mode[16],
        *class[] = {"begin%*[ ]%15s%*[ ]%n", "begin-base64%*[ ]%15s%*[ ]%n"};
+  struct linebuf *lb;
 
   if (toys.optc) ifd = xopen(*toys.optargs, O_RDONLY);
+  lb = linebuf_new(ifd);
 
   while (!idx) {
-    free(line);
-    if (!(line = get_line(ifd))) error_exit("bad EOF");
+    if (!(line = linebuf_line(lb))) error_exit("bad EOF");
     for (m=0; m < 2; m++) {
       sscanf(line, class[m], mode, &idx);
       if (idx) break;
@@ -48,8 +49,7 @@ void uudecode_main(void)
     char *in, *out;
     int olen;
 
-    free(line);
-    if (m == 2 || !(line = get_line(ifd))) break;
+    if (m == 2 || !(line = linebuf_line(lb))) break;
     if (!strcmp(line, m ? "====" : "end")) {
       m = 2;
       continue;
@@ -101,6 +101,7 @@ line_done:
   }
 
   if (CFG_TOYBOX_FREE) {
+    linebuf_free(lb);
     if (ifd) close(ifd);
     close(ofd);
   }